@@ -0,0 +1,100 @@
+//Converts maps between the text format and the binary format (see save_map_binary). Text
+//maps and scenario files become binary, next to the input with a .bmap extension, and
+//binary maps become text maps. load_map and load_scenario read either format, so a
+//converted file can be used anywhere the original was.
+//
+//Build it like sim_bench, with BMT_USE_LZ4 defined and lz4 linked for --lz4.
+//
+//usage: map_convert [--lz4] [-o out] data/file.txt|data/file.scn|data/file.bmap ...
+
+#include <chrono>
+#include <string>
+#include "../game/map.h"
+
+static inline
+std::string replace_extension(const char* filename, const char* extension) {
+	std::string result = filename;
+	size_t dot = result.rfind('.');
+	size_t slash = result.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		result.erase(dot);
+	return result + extension;
+}
+
+static inline
+f64 seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+}
+
+static inline
+long file_size(const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+static inline
+void convert(const char* input, const char* output, bool compress) {
+	if (is_map_binary(input)) {
+		std::string out = output != NULL ? output : replace_extension(input, ".txt");
+		Game game = load_scenario_binary(input);
+		if (game.waves.size() > 0 || game.map.goldpiles.size() > 0 || game.map.turrets.size() > 0)
+			BMT_LOG(WARNING, "[%s] The text format only holds tiles, units and walls, the rest is left out", input);
+		save_map(&game.map, out.c_str());
+		printf("%s -> %s\n", input, out.c_str());
+		dispose_map(&game.map);
+		return;
+	}
+
+	std::string out = output != NULL ? output : replace_extension(input, ".bmap");
+	Game game = { GAME_MENU };
+	bool scenario = has_extension(input, "scn");
+
+	auto start = std::chrono::steady_clock::now();
+	if (scenario)
+		game = load_scenario(input);
+	else
+		game.map = load_map(input);
+	f64 textSeconds = seconds_since(start);
+
+	save_map_binary(&game.map, out.c_str(), scenario ? &game : NULL, compress);
+	dispose_map(&game.map);
+
+	//read it straight back, which checks the file and shows what the format saves
+	start = std::chrono::steady_clock::now();
+	Map map = load_map(out.c_str());
+	f64 binarySeconds = seconds_since(start);
+	printf("%s -> %s: %dx%d, %ld -> %ld bytes, load %.2f ms -> %.2f ms\n", input, out.c_str(), map.width, map.height,
+		file_size(input), file_size(out.c_str()), textSeconds * 1000, binarySeconds * 1000);
+	dispose_map(&map);
+}
+
+int main(int argc, char** argv) {
+	bool compress = false;
+	const char* output = NULL;
+	std::vector<const char*> inputs;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--lz4") == 0)
+			compress = true;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	if (inputs.size() == 0) {
+		printf("usage: map_convert [--lz4] [-o out] data/file.txt|data/file.scn|data/file.bmap ...\n");
+		return 1;
+	}
+	if (output != NULL && inputs.size() > 1)
+		BMT_LOG(FATAL_ERROR, "-o only works with a single input");
+
+	for (u32 i = 0; i < inputs.size(); ++i)
+		convert(inputs[i], output, compress);
+	return 0;
+}
@@ -0,0 +1,417 @@
+//Stress scenario generator. Writes a map of any size in the format load_map reads, with
+//islands, autotiled coastlines and layer 2/3 decoration, and a scenario file (see
+//load_scenario) with gold piles, starter walls, turrets and waves of thousands of boats
+//from all four sides. Play the result with `game --scenario file` or time it with
+//`sim_bench --scenario file`.
+//
+//Build it like sim_bench. The tile ids are the ones the shipped maps use from tilesheet.png.
+//
+//usage: map_gen data/out.txt [--width n] [--height n] [--seed n] [--islands n] [--gold n]
+//               [--walls n] [--turrets n] [--boats n] [--waves n] [--money n] [--time n]
+//               [--scenario data/out.scn]
+
+#include <string>
+#include "../game/map.h"
+
+#define GEN_WATER			72
+#define GEN_GRASS			22
+#define GEN_BORDER			3
+#define GEN_NOISE_CELL		8
+#define GEN_NOISE_AMOUNT	0.45f
+#define GEN_DECORATION		3	//percent of inland tiles decorated on each of layer 2 and 3
+#define GEN_GOLD_SPACING	10
+
+//coast tiles, from the 3x3 block around tile 26 and the inner corners below it
+#define GEN_COAST_N		10
+#define GEN_COAST_S		42
+#define GEN_COAST_W		25
+#define GEN_COAST_E		27
+#define GEN_COAST_NW	9
+#define GEN_COAST_NE	11
+#define GEN_COAST_SW	41
+#define GEN_COAST_SE	43
+#define GEN_INNER_NE	73
+#define GEN_INNER_NW	74
+#define GEN_INNER_SE	57
+#define GEN_INNER_SW	58
+
+GLOBAL const i16 LAYER2_DECORATION[] = { 50, 64, 65, 69, 70, 71 };
+GLOBAL const i16 LAYER3_DECORATION[] = { 48, 49, 66, 86, 87 };
+
+//boats are mostly dinghies, the rest weighted towards the cheaper ships
+GLOBAL const UnitType WAVE_SHIPS[] = {
+	UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY,
+	UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP,
+	UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP,
+	UNIT_MAGE_SHIP, UNIT_MAGE_SHIP,
+	UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP,
+	UNIT_GOLIATH_SHIP
+};
+GLOBAL const char SIDES[] = { 'n', 's', 'e', 'w' };
+
+struct GenOptions {
+	const char* mapfile;
+	std::string scenariofile;
+	u32 width;
+	u32 height;
+	u32 seed;
+	u32 islands;
+	u32 gold;
+	u32 walls;
+	u32 turrets;
+	u32 boats;
+	u32 waves;
+	u32 money;
+	u32 time;
+};
+
+static inline
+f32 random_unit() {
+	return random_int(0, 10000) / 10000.0f;
+}
+
+static inline
+bool is_land(Map* map, i32 x, i32 y) {
+	if (x < 0 || y < 0 || x >= (i32)map->width || y >= (i32)map->height)
+		return false;
+	return map->grid[0][x + y * map->width] != GEN_WATER;
+}
+
+//bilinear value noise over a coarse grid of random values, in [0, 1]
+static inline
+std::vector<f32> create_noise(u32 width, u32 height) {
+	u32 cellsx = width / GEN_NOISE_CELL + 2;
+	u32 cellsy = height / GEN_NOISE_CELL + 2;
+	std::vector<f32> cells(cellsx * cellsy);
+	for (u32 i = 0; i < cells.size(); ++i)
+		cells[i] = random_unit();
+
+	std::vector<f32> noise(width * height);
+	for (u32 y = 0; y < height; ++y) {
+		for (u32 x = 0; x < width; ++x) {
+			u32 cx = x / GEN_NOISE_CELL;
+			u32 cy = y / GEN_NOISE_CELL;
+			f32 fx = (x % GEN_NOISE_CELL) / (f32)GEN_NOISE_CELL;
+			f32 fy = (y % GEN_NOISE_CELL) / (f32)GEN_NOISE_CELL;
+			f32 top = cells[cx + cy * cellsx] * (1 - fx) + cells[cx + 1 + cy * cellsx] * fx;
+			f32 bottom = cells[cx + (cy + 1) * cellsx] * (1 - fx) + cells[cx + 1 + (cy + 1) * cellsx] * fx;
+			noise[x + y * width] = top * (1 - fy) + bottom * fy;
+		}
+	}
+	return noise;
+}
+
+//round islands with noisy edges, kept GEN_BORDER tiles away from the edges so every side
+//has open water for boats to spawn in
+static inline
+void raise_islands(Map* map, u32 islands) {
+	std::vector<f32> noise = create_noise(map->width, map->height);
+	f32 inner = (f32)std::min(map->width, map->height) - GEN_BORDER * 2;
+	f32 maxRadius = std::max(3.0f, inner / (2.0f * sqrtf((f32)islands)));
+
+	for (u32 i = 0; i < islands; ++i) {
+		f32 radius = maxRadius * (0.5f + random_unit() * 0.5f);
+		f32 cx = GEN_BORDER + radius + random_unit() * std::max(0.0f, map->width - GEN_BORDER * 2 - radius * 2);
+		f32 cy = GEN_BORDER + radius + random_unit() * std::max(0.0f, map->height - GEN_BORDER * 2 - radius * 2);
+
+		i32 x0 = std::max((i32)GEN_BORDER, (i32)(cx - radius * 1.5f));
+		i32 y0 = std::max((i32)GEN_BORDER, (i32)(cy - radius * 1.5f));
+		i32 x1 = std::min((i32)map->width - GEN_BORDER, (i32)(cx + radius * 1.5f) + 1);
+		i32 y1 = std::min((i32)map->height - GEN_BORDER, (i32)(cy + radius * 1.5f) + 1);
+		for (i32 y = y0; y < y1; ++y) {
+			for (i32 x = x0; x < x1; ++x) {
+				f32 dist = getDistanceE(x, y, cx, cy) / radius;
+				if (dist + (noise[x + y * map->width] - 0.5f) * GEN_NOISE_AMOUNT * 2 < 1)
+					map->grid[0][x + y * map->width] = GEN_GRASS;
+			}
+		}
+	}
+}
+
+//picks the coast tile for a land tile from where the water around it is, or returns -1
+//when the tilesheet has no tile for the shape (one tile wide strips, opposite corners)
+static inline
+i16 coast_tile(Map* map, i32 x, i32 y) {
+	bool n = !is_land(map, x, y - 1);
+	bool s = !is_land(map, x, y + 1);
+	bool w = !is_land(map, x - 1, y);
+	bool e = !is_land(map, x + 1, y);
+	bool ne = !is_land(map, x + 1, y - 1);
+	bool nw = !is_land(map, x - 1, y - 1);
+	bool se = !is_land(map, x + 1, y + 1);
+	bool sw = !is_land(map, x - 1, y + 1);
+
+	if ((n && s) || (e && w))
+		return -1;
+	if (n && w)
+		return se ? -1 : GEN_COAST_NW;
+	if (n && e)
+		return sw ? -1 : GEN_COAST_NE;
+	if (s && w)
+		return ne ? -1 : GEN_COAST_SW;
+	if (s && e)
+		return nw ? -1 : GEN_COAST_SE;
+	if (n)
+		return se || sw ? -1 : GEN_COAST_N;
+	if (s)
+		return ne || nw ? -1 : GEN_COAST_S;
+	if (w)
+		return ne || se ? -1 : GEN_COAST_W;
+	if (e)
+		return nw || sw ? -1 : GEN_COAST_E;
+
+	u32 corners = ne + nw + se + sw;
+	if (corners > 1)
+		return -1;
+	if (ne)
+		return GEN_INNER_NE;
+	if (nw)
+		return GEN_INNER_NW;
+	if (se)
+		return GEN_INNER_SE;
+	if (sw)
+		return GEN_INNER_SW;
+	return GEN_GRASS;
+}
+
+//sinks land the tilesheet can't draw a coast for until every land tile has one
+static inline
+void shape_coastlines(Map* map) {
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (u32 y = 0; y < map->height; ++y) {
+			for (u32 x = 0; x < map->width; ++x) {
+				if (is_land(map, x, y) && coast_tile(map, x, y) == -1) {
+					map->grid[0][x + y * map->width] = GEN_WATER;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	//tiles are picked only once the shape is final, since sinking changes the neighbours
+	std::vector<i16> tiles(map->width * map->height, GEN_WATER);
+	for (u32 y = 0; y < map->height; ++y) {
+		for (u32 x = 0; x < map->width; ++x) {
+			if (is_land(map, x, y))
+				tiles[x + y * map->width] = coast_tile(map, x, y);
+		}
+	}
+	memcpy(map->grid[0], tiles.data(), tiles.size() * sizeof(i16));
+}
+
+static inline
+void decorate(Map* map) {
+	u32 n2 = sizeof(LAYER2_DECORATION) / sizeof(LAYER2_DECORATION[0]);
+	u32 n3 = sizeof(LAYER3_DECORATION) / sizeof(LAYER3_DECORATION[0]);
+	for (u32 i = 0; i < (u32)map->width * map->height; ++i) {
+		if (map->grid[0][i] != GEN_GRASS)
+			continue;
+		if (random_int(0, 99) < GEN_DECORATION)
+			map->grid[1][i] = LAYER2_DECORATION[random_int(0, n2 - 1)];
+		else if (random_int(0, 99) < GEN_DECORATION)
+			map->grid[2][i] = LAYER3_DECORATION[random_int(0, n3 - 1)];
+	}
+}
+
+//gold goes on open grass with room for a ring of walls around it
+static inline
+bool can_hold_gold(Map* map, i32 x, i32 y) {
+	for (i32 dy = -2; dy <= 2; ++dy) {
+		for (i32 dx = -2; dx <= 2; ++dx) {
+			if (!is_land(map, x + dx, y + dy) || map->grid[0][(x + dx) + (y + dy) * map->width] != GEN_GRASS)
+				return false;
+		}
+	}
+	for (u32 i = 0; i < map->goldpiles.size(); ++i) {
+		if (getDistanceE(x, y, map->goldpiles[i].x, map->goldpiles[i].y) < GEN_GOLD_SPACING)
+			return false;
+	}
+	return true;
+}
+
+static inline
+void place_gold(Map* map, u32 gold) {
+	for (u32 attempt = 0; attempt < gold * 1000 && map->goldpiles.size() < gold; ++attempt) {
+		i32 x = random_int(0, map->width - 1);
+		i32 y = random_int(0, map->height - 1);
+		if (can_hold_gold(map, x, y))
+			map->goldpiles.push_back({ (i16)x, (i16)y, 10 });
+	}
+	if (map->goldpiles.size() < gold)
+		BMT_LOG(WARNING, "Only found room for %d of %d gold piles", (i32)map->goldpiles.size(), gold);
+}
+
+//walls go on the ring two tiles out from each gold pile, corners and middles first, and
+//turrets go on those walls in the same order
+static inline
+void place_walls(Map* map, u32 walls, std::vector<Turret>* turrets, u32 numTurrets) {
+	LOCAL const i8 RING[16][2] = {
+		{ -2, -2 }, { 2, -2 }, { -2, 2 }, { 2, 2 },
+		{ 0, -2 }, { 0, 2 }, { -2, 0 }, { 2, 0 },
+		{ -1, -2 }, { 1, -2 }, { -1, 2 }, { 1, 2 },
+		{ -2, -1 }, { -2, 1 }, { 2, -1 }, { 2, 1 }
+	};
+	if (map->goldpiles.size() == 0)
+		return;
+
+	u32 placed = 0;
+	for (u32 r = 0; r < 16 && placed < walls; ++r) {
+		for (u32 i = 0; i < map->goldpiles.size() && placed < walls; ++i) {
+			i32 x = map->goldpiles[i].x + RING[r][0];
+			i32 y = map->goldpiles[i].y + RING[r][1];
+			Wall* wall = &map->walls[x + y * map->width];
+			wall->active = true;
+			wall->hp = WALL_HP;
+			placed++;
+
+			if (turrets->size() < numTurrets) {
+				Turret turret = { 0 };
+				turret.x = x;
+				turret.y = y;
+				turret.type = (TurretType)(turrets->size() % 3);
+				turrets->push_back(turret);
+			}
+		}
+	}
+	if (placed < walls)
+		BMT_LOG(WARNING, "Only placed %d of %d walls, the rings around the gold are full", placed, walls);
+	if (turrets->size() < numTurrets)
+		BMT_LOG(WARNING, "Only placed %d of %d turrets, there is one per wall", (i32)turrets->size(), numTurrets);
+}
+
+//boats ramp up linearly, so the last wave is the biggest, and the last wave brings Edric
+static inline
+void write_waves(FILE* file, u32 boats, u32 waves) {
+	u32 numShips = sizeof(WAVE_SHIPS) / sizeof(WAVE_SHIPS[0]);
+	u32 total = waves * (waves + 1) / 2;
+	u32 remaining = boats;
+
+	for (u32 wave = 0; wave < waves; ++wave) {
+		u32 count = wave == waves - 1 ? remaining : std::min(remaining, boats * (wave + 1) / total);
+		remaining -= count;
+		if (wave == waves - 1)
+			count++;
+
+		fprintf(file, "wave %d", count);
+		for (u32 i = 0; i < count; ++i) {
+			UnitType type = WAVE_SHIPS[random_int(0, numShips - 1)];
+			if (wave == waves - 1 && i == count - 1)
+				type = UNIT_EDRIC_SHIP;
+			fprintf(file, " %d %c", (i32)type, SIDES[random_int(0, 3)]);
+		}
+		fprintf(file, "\n");
+	}
+}
+
+static inline
+void write_scenario(GenOptions* options, Map* map, std::vector<Turret>* turrets) {
+	FILE* file = fopen(options->scenariofile.c_str(), "w");
+	if (file == NULL)
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", options->scenariofile.c_str());
+
+	fprintf(file, "#scenario generated by map_gen --seed %d\n", options->seed);
+	fprintf(file, "map %s\n", options->mapfile);
+	fprintf(file, "money %d\n", options->money);
+	fprintf(file, "time %d\n", options->time);
+	for (u32 i = 0; i < map->goldpiles.size(); ++i)
+		fprintf(file, "gold %d %d %d\n", map->goldpiles[i].x, map->goldpiles[i].y, map->goldpiles[i].coins);
+	for (u32 i = 0; i < turrets->size(); ++i)
+		fprintf(file, "turret %d %d %d\n", (*turrets)[i].x, (*turrets)[i].y, (i32)(*turrets)[i].type);
+	write_waves(file, options->boats, options->waves);
+
+	fclose(file);
+}
+
+int main(int argc, char** argv) {
+	GenOptions options = { 0 };
+	options.width = 256;
+	options.height = 256;
+	options.seed = 1;
+	options.gold = 4;
+	options.walls = 32;
+	options.turrets = 16;
+	options.boats = 2000;
+	options.waves = 10;
+	options.money = 3000;
+	options.time = 2800;
+
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] != '-')
+			options.mapfile = argv[i];
+		else if (i + 1 >= argc)
+			BMT_LOG(FATAL_ERROR, "%s needs a value", argv[i]);
+		else if (strcmp(argv[i], "--scenario") == 0)
+			options.scenariofile = argv[++i];
+		else if (strcmp(argv[i], "--width") == 0)
+			options.width = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--height") == 0)
+			options.height = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0)
+			options.seed = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--islands") == 0)
+			options.islands = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--gold") == 0)
+			options.gold = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--walls") == 0)
+			options.walls = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--turrets") == 0)
+			options.turrets = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--boats") == 0)
+			options.boats = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--waves") == 0)
+			options.waves = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--money") == 0)
+			options.money = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--time") == 0)
+			options.time = atoi(argv[++i]);
+		else
+			BMT_LOG(FATAL_ERROR, "Unknown option %s", argv[i]);
+	}
+
+	if (options.mapfile == NULL) {
+		printf("usage: map_gen data/out.txt [--width n] [--height n] [--seed n] [--islands n] [--gold n]\n");
+		printf("               [--walls n] [--turrets n] [--boats n] [--waves n] [--money n] [--time n]\n");
+		printf("               [--scenario data/out.scn]\n");
+		return 1;
+	}
+	if (options.width < GEN_BORDER * 2 + 5 || options.height < GEN_BORDER * 2 + 5 || options.width > MAP_MAX_SIZE || options.height > MAP_MAX_SIZE)
+		BMT_LOG(FATAL_ERROR, "Map size %dx%d is out of range", options.width, options.height);
+	if (options.waves == 0)
+		options.waves = 1;
+	//about one island per 64x64 tiles unless asked for
+	if (options.islands == 0)
+		options.islands = std::max(1u, (options.width * options.height) / (64 * 64));
+	if (options.scenariofile.empty()) {
+		options.scenariofile = options.mapfile;
+		size_t dot = options.scenariofile.rfind('.');
+		if (dot != std::string::npos)
+			options.scenariofile.erase(dot);
+		options.scenariofile += ".scn";
+	}
+
+	seed_random(options.seed);
+	Map map = create_map(options.width, options.height);
+	raise_islands(&map, options.islands);
+	shape_coastlines(&map);
+	decorate(&map);
+	place_gold(&map, options.gold);
+
+	std::vector<Turret> turrets;
+	place_walls(&map, options.walls, &turrets, options.turrets);
+
+	//gold piles and turrets are set up by the scenario, the map file only holds tiles and walls
+	save_map(&map, options.mapfile);
+	write_scenario(&options, &map, &turrets);
+
+	u32 land = 0;
+	for (u32 i = 0; i < options.width * options.height; ++i) {
+		if (map.grid[0][i] != GEN_WATER)
+			land++;
+	}
+	printf("%s: %dx%d, %d islands, %d%% land, %d gold piles, %d turrets\n", options.mapfile, options.width, options.height,
+		options.islands, land * 100 / (options.width * options.height), (i32)map.goldpiles.size(), (i32)turrets.size());
+	printf("%s: %d boats in %d waves\n", options.scenariofile.c_str(), options.boats + 1, options.waves);
+	return 0;
+}
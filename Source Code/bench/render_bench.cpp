@@ -0,0 +1,310 @@
+//Offscreen RenderBatch benchmark. Makes a GL context with EGL and no window or display (Mesa's
+//llvmpipe is enough), draws into a framebuffer object, and pushes synthetic sprites through
+//draw_texture, draw_texture_rotated, draw_texture_EX and draw_text at different sprite counts
+//and numbers of textures. Reports sprites per second, both end to end and for the batch's CPU
+//side alone, and draw calls / flushes per frame, so changes to the batch can be measured
+//without the game in the way.
+//
+//Build it like the game from this file alone, and also link EGL. Without --font the draw_text
+//workloads are skipped.
+//
+//--array draws the same synthetic textures as layers of one TextureArray, through
+//begin2D_array and load_array_shader_2D, instead of binding them to the 16 texture slots.
+//Text can't be drawn in an array batch, so draw_text is skipped there.
+//
+//usage: render_bench [--frames n] [--stream orphan|ring] [--font file.ttf] [--csv file] [--array]
+
+#include <chrono>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "../engine/render2D.h"
+
+#define BENCH_WIDTH			1280
+#define BENCH_HEIGHT		720
+#define BENCH_WARMUP_FRAMES	5
+#define BENCH_MAX_TEXTURES	64
+
+enum BenchCall {
+	CALL_TEXTURE,
+	CALL_ROTATED,
+	CALL_EX,
+	CALL_TEXT
+};
+
+GLOBAL const char* CALL_NAMES[] = { "draw_texture", "draw_texture_rotated", "draw_texture_EX", "draw_text" };
+GLOBAL const u32 SPRITE_COUNTS[] = { 1000, 10000, 100000 };
+GLOBAL const u32 TEXTURE_COUNTS[] = { 1, 16, BENCH_MAX_TEXTURES };
+
+struct BenchResult {
+	f64 seconds;
+	f64 cpuSeconds; //begin2D through end2D only, which still includes any wait on a ring region's fence
+	RenderStats stats; //of the last frame, every frame draws the same thing
+	f32 gpuMs;
+};
+
+//tries Mesa's surfaceless platform first, which needs no X or Wayland display at all
+static inline
+bool create_offscreen_context() {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		BMT_LOG(MINOR_ERROR, "Could not initialize an EGL display");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		BMT_LOG(MINOR_ERROR, "EGL display does not support desktop OpenGL");
+		return false;
+	}
+
+	//no surface is ever made, so any surface type will do
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_DONT_CARE, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+		BMT_LOG(MINOR_ERROR, "No EGL config supports desktop OpenGL");
+		return false;
+	}
+
+	//the same version the game asks GLFW for
+	EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE };
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT) {
+		BMT_LOG(MINOR_ERROR, "Could not create an OpenGL 3.0 context");
+		return false;
+	}
+
+	//everything is drawn into a framebuffer object, so the context never needs a surface
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		BMT_LOG(MINOR_ERROR, "Could not make the context current without a surface");
+		return false;
+	}
+
+	bmtGetProcAddress = (GLADloadproc)eglGetProcAddress;
+	if (!gladLoadGLLoader(bmtGetProcAddress)) {
+		BMT_LOG(MINOR_ERROR, "Failed to initialize GLAD");
+		return false;
+	}
+
+	BMT_LOG(INFO, "OpenGL Version: %s", glGetString(GL_VERSION));
+	BMT_LOG(INFO, "Graphics Card: %s", glGetString(GL_RENDERER));
+	return true;
+}
+
+static inline
+void create_render_target() {
+	GLuint fbo, color;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, BENCH_WIDTH, BENCH_HEIGHT);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+//solid 32x32 textures, each a different color so no two can be mistaken for one another
+static inline
+void fill_bench_pixels(unsigned char pixels[32 * 32 * 4], u32 index) {
+	for (u32 p = 0; p < 32 * 32; ++p) {
+		pixels[(p * 4) + 0] = (index * 53) % 256;
+		pixels[(p * 4) + 1] = (index * 97) % 256;
+		pixels[(p * 4) + 2] = (index * 151) % 256;
+		pixels[(p * 4) + 3] = 255;
+	}
+}
+
+static inline
+void create_bench_textures(Texture textures[BENCH_MAX_TEXTURES]) {
+	unsigned char pixels[32 * 32 * 4];
+	for (u32 i = 0; i < BENCH_MAX_TEXTURES; ++i) {
+		fill_bench_pixels(pixels, i);
+		textures[i] = load_texture(pixels, 32, 32, GL_NEAREST);
+	}
+}
+
+//the same textures as layers of one array
+static inline
+TextureArray create_bench_texture_array(Texture layers[BENCH_MAX_TEXTURES]) {
+	TextureArray arr = create_texture_array(32, 32, BENCH_MAX_TEXTURES, GL_NEAREST);
+	unsigned char pixels[32 * 32 * 4];
+	for (u32 i = 0; i < BENCH_MAX_TEXTURES; ++i) {
+		fill_bench_pixels(pixels, i);
+		layers[i] = add_texture_array_layer(&arr, pixels, 32, 32);
+	}
+	return arr;
+}
+
+static inline
+void draw_workload(RenderBatch* batch, BenchCall call, u32 sprites, Texture* textures, u32 textureCount, Font* font) {
+	LOCAL const char* TEXT = "The quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	u32 textLength = strlen(TEXT);
+
+	if (call == CALL_TEXT) {
+		for (u32 drawn = 0, line = 0; drawn < sprites; drawn += textLength, ++line)
+			draw_text(batch, font, TEXT, (line * 37) % BENCH_WIDTH, (line * 23) % BENCH_HEIGHT, 255, 255, 255);
+		return;
+	}
+
+	for (u32 i = 0; i < sprites; ++i) {
+		Texture tex = textures[i % textureCount];
+		i32 x = (i * 37) % BENCH_WIDTH;
+		i32 y = (i * 91) % BENCH_HEIGHT;
+
+		switch (call) {
+		case CALL_TEXTURE: draw_texture(batch, tex, x, y); break;
+		case CALL_ROTATED: draw_texture_rotated(batch, tex, x, y, (f32)(i % 360)); break;
+		case CALL_EX: draw_texture_EX(batch, tex, { 0, 0, 16, 16 }, { (f32)x, (f32)y, 48, 48 }); break;
+		default: break;
+		}
+	}
+}
+
+static inline
+BenchResult run_workload(RenderBatch* batch, Shader shader, TextureArray* arr, BenchCall call, u32 sprites, Texture* textures, u32 textureCount, Font* font, u32 frames) {
+	BenchResult result = { 0 };
+	mat4 projection = orthographic_projection(0, 0, BENCH_WIDTH, BENCH_HEIGHT, -1, 1);
+
+	std::chrono::steady_clock::time_point start;
+	for (u32 frame = 0; frame < BENCH_WARMUP_FRAMES + frames; ++frame) {
+		if (frame == BENCH_WARMUP_FRAMES)
+			start = std::chrono::steady_clock::now();
+
+		reset_render_stats(batch);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		auto submitStart = std::chrono::steady_clock::now();
+		if (arr != NULL)
+			begin2D_array(batch, shader, *arr);
+		else
+			begin2D(batch, shader);
+		upload_mat4(shader, "projection", projection);
+		draw_workload(batch, call, sprites, textures, textureCount, font);
+		end2D(batch);
+		if (frame >= BENCH_WARMUP_FRAMES)
+			result.cpuSeconds += std::chrono::duration<f64>(std::chrono::steady_clock::now() - submitStart).count();
+
+		//wait for the GPU too, so the total includes drawing and not just queueing
+		glFinish();
+	}
+	result.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+	reset_render_stats(batch);
+	result.stats = get_render_stats(batch);
+	result.gpuMs = get_gpu_timings(batch).frameMs;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	const char* fontfile = NULL;
+	const char* csvfile = NULL;
+	BatchStreaming streaming = BATCH_STREAM_ORPHAN;
+	u32 frames = 60;
+	bool useArray = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			streaming = strcmp(argv[++i], "ring") == 0 ? BATCH_STREAM_RING : BATCH_STREAM_ORPHAN;
+		else if (strcmp(argv[i], "--font") == 0 && i + 1 < argc)
+			fontfile = argv[++i];
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvfile = argv[++i];
+		else if (strcmp(argv[i], "--array") == 0)
+			useArray = true;
+	}
+
+	if (!create_offscreen_context())
+		return 1;
+	create_render_target();
+	set_trace_enabled(false);
+
+	RenderBatch batch = create_batch(streaming);
+	Shader shader = useArray ? load_array_shader_2D() : load_default_shader_2D();
+	Texture textures[BENCH_MAX_TEXTURES];
+	TextureArray arr = { 0 };
+	if (useArray)
+		arr = create_bench_texture_array(textures);
+	else
+		create_bench_textures(textures);
+
+	Font font = { 0 };
+	if (fontfile != NULL)
+		font = load_font(fontfile, 24, GL_LINEAR);
+	if (font.face == NULL && !useArray)
+		BMT_LOG(WARNING, "No font given with --font, skipping draw_text");
+
+	FILE* csv = NULL;
+	if (csvfile != NULL) {
+		csv = fopen(csvfile, "a");
+		if (csv == NULL)
+			BMT_LOG(FATAL_ERROR, "[%s] Could not open the csv file", csvfile);
+		fseek(csv, 0, SEEK_END);
+		if (ftell(csv) == 0)
+			fprintf(csv, "call,streaming,pipeline,sprites,textures,frames,sprites_per_second,cpu_sprites_per_second,ms_per_frame,cpu_ms_per_frame,draw_calls,texture_flushes,buffer_flushes,gpu_ms\n");
+	}
+
+	//cpu is the batch's own cost of taking the sprites; the rest is the driver and GPU drawing them,
+	//which dominates on a software rasterizer
+	printf("%-22s %8s %8s | %12s %9s | %12s %9s | %10s %10s %10s | %8s\n", "call", "sprites", "textures",
+		"sprites/s", "ms/frame", "cpu sprites/s", "cpu ms", "draw calls", "tex flush", "buf flush", "gpu ms");
+
+	for (u32 c = 0; c < sizeof(CALL_NAMES) / sizeof(CALL_NAMES[0]); ++c) {
+		BenchCall call = (BenchCall)c;
+		if (call == CALL_TEXT && (font.face == NULL || useArray))
+			continue;
+
+		for (u32 s = 0; s < sizeof(SPRITE_COUNTS) / sizeof(SPRITE_COUNTS[0]); ++s) {
+			for (u32 t = 0; t < sizeof(TEXTURE_COUNTS) / sizeof(TEXTURE_COUNTS[0]); ++t) {
+				//text always uses one texture per glyph, so there is nothing to vary
+				if (call == CALL_TEXT && t > 0)
+					break;
+
+				u32 sprites = SPRITE_COUNTS[s];
+				BenchResult result = run_workload(&batch, shader, useArray ? &arr : NULL, call, sprites, textures, TEXTURE_COUNTS[t], &font, frames);
+				RenderStats* stats = &result.stats;
+				f64 spritesPerSecond = (f64)stats->sprites * frames / result.seconds;
+				f64 cpuSpritesPerSecond = (f64)stats->sprites * frames / result.cpuSeconds;
+				f64 msPerFrame = result.seconds * 1000 / frames;
+				f64 cpuMsPerFrame = result.cpuSeconds * 1000 / frames;
+				//an array batch binds one texture however many of its layers are drawn
+				u32 textureCount = useArray ? TEXTURE_COUNTS[t] : stats->uniqueTextures;
+
+				printf("%-22s %8d %8d | %12.0f %9.3f | %12.0f %9.3f | %10d %10d %10d | %8.3f\n",
+					CALL_NAMES[c], stats->sprites, textureCount, spritesPerSecond, msPerFrame, cpuSpritesPerSecond,
+					cpuMsPerFrame, stats->drawCalls, stats->textureFlushes, stats->bufferFlushes, result.gpuMs);
+				//the large workloads take a while on a software rasterizer, so show each row as it finishes
+				fflush(stdout);
+				if (csv != NULL) {
+					fprintf(csv, "%s,%s,%s,%d,%d,%d,%.0f,%.0f,%.4f,%.4f,%d,%d,%d,%.4f\n", CALL_NAMES[c],
+						batch.streaming == BATCH_STREAM_RING ? "ring" : "orphan", useArray ? "array" : "slots", stats->sprites, textureCount, frames,
+						spritesPerSecond, cpuSpritesPerSecond, msPerFrame, cpuMsPerFrame, stats->drawCalls, stats->textureFlushes,
+						stats->bufferFlushes, result.gpuMs);
+				}
+			}
+		}
+	}
+
+	if (csv != NULL)
+		fclose(csv);
+	if (font.face != NULL)
+		dispose_font(font);
+	if (useArray) {
+		dispose_texture_array(arr);
+	}
+	else {
+		for (u32 i = 0; i < BENCH_MAX_TEXTURES; ++i)
+			dispose_texture(textures[i]);
+	}
+	dispose_batch(&batch);
+	return 0;
+}
@@ -0,0 +1,397 @@
+//Headless simulation benchmark. Runs update_game on generated maps with a seeded fort
+//layout and scripted waves, without opening a window, and reports ticks per second,
+//time per simulation phase, peak entity counts and how the game stood at the end.
+//
+//Build it like the game (same include paths and libraries) from this file alone, and run
+//it from the game's directory if real sprite sizes should be read from data/art.
+//
+//usage: sim_bench [scenario|all] [--ticks n] [--seed n] [--map data/file.txt] [--csv file] [--no-lod] [--workers n]
+//       sim_bench --scenario data/file.scn [--ticks n] [--seed n] [--csv file] [--no-lod] [--workers n]
+//       sim_bench --replay data/last.replay [--ticks n] [--csv file] [--no-lod] [--workers n]
+//
+//--scenario runs a scenario file (see load_scenario and map_gen) instead of the built in
+//scenarios, with its own map, fort and waves.
+//
+//--replay runs a recorded game (see replay.h) with the player's commands, from its own
+//seed and for as many ticks as were recorded unless --ticks says otherwise.
+//
+//--no-lod runs every unit at full fidelity (see update_focus). Comparing the end of game
+//numbers over a few seeds with and without it checks reduced fidelity plays out the same.
+//
+//--workers starts n job workers (see jobs.h) to steer units alongside the main thread. By
+//default there are none and everything runs on the main thread. The end of game numbers
+//are the same for any number of workers.
+
+#include <chrono>
+#include <string>
+#include "../game/replay.h"
+
+struct BenchScenario {
+	const char* name;
+	u32 invaders;
+	u32 turrets;
+	u32 width;
+	u32 height;
+	u32 ticks;
+};
+
+//invaders scale the O(n^2) separation and targeting, turrets scale get_closest_enemy,
+//and map size scales the whole-map wall scans in retargeting and projectile collision
+GLOBAL BenchScenario SCENARIOS[] = {
+	{ "invaders-100",   100,   10,  40,  30, 3000 },
+	{ "invaders-1k",    1000,  10,  64,  64, 1000 },
+	{ "invaders-10k",   10000, 10,  128, 128, 200 },
+	{ "turrets-10",     100,   10,  64,  64, 3000 },
+	{ "turrets-100",    100,   100, 64,  64, 3000 },
+	{ "turrets-1000",   100,   1000, 64, 64, 3000 },
+	{ "map-40x30",      100,   10,  40,  30, 3000 },
+	{ "map-128x128",    100,   10,  128, 128, 1000 },
+	{ "map-256x256",    100,   10,  256, 256, 300 },
+	{ "map-512x512",    100,   10,  512, 512, 100 },
+};
+
+#define BENCH_LAND_TILE		0
+#define BENCH_WAVES			4
+#define BENCH_WAVE_INTERVAL	250
+
+//the phases update_game profiles, in the order it runs them
+GLOBAL const char* PHASES[] = { "spawn", "turrets", "retarget", "steering", "integration", "projectiles", "explosions" };
+#define BENCH_NUM_PHASES (sizeof(PHASES) / sizeof(PHASES[0]))
+
+struct BenchResult {
+	f64 seconds;
+	f64 phaseMs[BENCH_NUM_PHASES];
+	f64 phaseMaxMs[BENCH_NUM_PHASES];
+	u32 peakUnits;
+	u32 peakProjectiles;
+	u32 peakExplosions;
+	u32 wave;
+	u32 money;
+	u32 coinsLeft;
+	u32 unitsLeft;
+};
+
+//update_game only reads the sizes of these, so nothing needs a GL context
+static inline
+Texture load_texture_size(const char* filepath) {
+	Texture tex = { 0 };
+	unsigned char* image = SOIL_load_image(filepath, &tex.width, &tex.height, 0, SOIL_LOAD_AUTO);
+	if (image == NULL) {
+		tex.width = TILE_SIZE;
+		tex.height = TILE_SIZE;
+	}
+	else {
+		SOIL_free_image_data(image);
+	}
+	return tex;
+}
+
+static inline
+MapScene load_headless_scene() {
+	MapScene scene = { 0 };
+	scene.cannon = load_texture_size("data/art/cannon.png");
+	scene.stone = load_texture_size("data/art/stone.png");
+	scene.cannonBall = load_texture_size("data/art/cannonBall.png");
+	scene.attackers[0] = load_texture_size("data/art/attacker1.png");
+	scene.attackerMage = load_texture_size("data/art/attackerMage.png");
+	scene.explosion = load_texture_size("data/art/explosion.png");
+	scene.fire = load_texture_size("data/art/fire.png");
+	scene.goliath = load_texture_size("data/art/goliath.png");
+	scene.boulder = load_texture_size("data/art/boulder.png");
+	scene.bigBoss = load_texture_size("data/art/The Ultimate Final Boss.png");
+	return scene;
+}
+
+//an island in the middle of the map, with a fifth of the map as water on each side
+static inline
+Map create_island_map(u32 width, u32 height) {
+	Map map = create_map(width, height);
+	for (u32 y = height / 5; y < height - (height / 5); ++y) {
+		for (u32 x = width / 5; x < width - (width / 5); ++x)
+			map.grid[0][x + y * width] = BENCH_LAND_TILE;
+	}
+	return map;
+}
+
+//gold in the middle of the island, and each turret on its own wall at a random land tile
+static inline
+void place_fort(Game* game, u32 turrets) {
+	Map* map = &game->map;
+	i16 goldx = map->width / 2;
+	i16 goldy = map->height / 2;
+	map->goldpiles.push_back({ goldx, goldy, 10 });
+
+	u32 land = 0;
+	for (u32 i = 0; i < (u32)map->width * map->height; ++i) {
+		if (map->grid[0][i] != 72)
+			land++;
+	}
+	if (turrets > land - 1) {
+		BMT_LOG(WARNING, "Only %d land tiles, placing %d turrets instead of %d", land, land - 1, turrets);
+		turrets = land - 1;
+	}
+
+	for (u32 i = 0; i < turrets; ++i) {
+		i16 x, y;
+		Wall* wall;
+		do {
+			x = random_int(0, map->width - 1);
+			y = random_int(0, map->height - 1);
+			wall = &map->walls[x + y * map->width];
+		} while (map->grid[0][x + y * map->width] == 72 || wall->active || (x == goldx && y == goldy));
+
+		wall->active = true;
+		wall->hp = WALL_HP;
+
+		Turret turret = { 0 };
+		turret.x = x;
+		turret.y = y;
+		turret.type = (TurretType)(i % 3);
+		turret.shotDelay = turret.type == TURRET_CANNON ? 140 : turret.type == TURRET_MAGE ? 300 : 105;
+		map->turrets.push_back(turret);
+	}
+	orient_walls(map);
+}
+
+//dinghies carry three invaders each, so this sends enough of them from all four sides
+static inline
+void add_bench_waves(Game* game, u32 invaders) {
+	LOCAL const char SIDES[] = { 'n', 's', 'e', 'w' };
+	u32 boats = (invaders + 2) / 3;
+	u32 perWave = (boats + BENCH_WAVES - 1) / BENCH_WAVES;
+
+	for (u32 wave = 0; wave < BENCH_WAVES && boats > 0; ++wave) {
+		std::string params;
+		for (u32 i = 0; i < perWave && boats > 0; ++i, --boats) {
+			params += std::to_string(UNIT_DINGHY);
+			params += ' ';
+			params += SIDES[i % 4];
+			params += ' ';
+		}
+		add_wave(game, params.c_str());
+	}
+}
+
+//fills in the scenario's sizes from what the file set up, so the report describes it
+static inline
+Game setup_scenario_file_game(BenchScenario* scenario, const char* scenariofile) {
+	Game game = load_scenario(scenariofile);
+	game.state = GAME_IDLE;
+	game.timer = game.nextWaveTime;
+
+	u32 boats = 0;
+	for (u32 i = 0; i < game.waves.size(); ++i)
+		boats += game.waves[i].size();
+	scenario->invaders = boats;
+	scenario->turrets = game.map.turrets.size();
+	scenario->width = game.map.width;
+	scenario->height = game.map.height;
+	return game;
+}
+
+static inline
+Game setup_replay_game(BenchScenario* scenario, Replay* replay) {
+	//only replays of a scenario file get by without the level manifest
+	LevelTable levels;
+	if (replay->level >= 0)
+		levels = load_level_table(LEVEL_MANIFEST);
+	Game game = start_replay(replay, &levels);
+	u32 boats = 0;
+	for (u32 i = 0; i < game.waves.size(); ++i)
+		boats += game.waves[i].size();
+	scenario->invaders = boats;
+	scenario->turrets = game.map.turrets.size();
+	scenario->width = game.map.width;
+	scenario->height = game.map.height;
+	return game;
+}
+
+static inline
+Game setup_bench_game(BenchScenario* scenario, const char* mapfile, const char* scenariofile, Replay* replay) {
+	if (replay != NULL)
+		return setup_replay_game(scenario, replay);
+	if (scenariofile != NULL)
+		return setup_scenario_file_game(scenario, scenariofile);
+
+	Game game = { GAME_IDLE };
+	if (mapfile != NULL)
+		game.map = load_map(mapfile);
+	else
+		game.map = create_island_map(scenario->width, scenario->height);
+
+	place_fort(&game, scenario->turrets);
+	add_bench_waves(&game, scenario->invaders);
+
+	//start with the first wave already due, rather than waiting out a planning phase
+	game.money = 1000;
+	game.nextWaveTime = BENCH_WAVE_INTERVAL;
+	game.timer = game.nextWaveTime;
+	return game;
+}
+
+static inline
+BenchResult run_scenario(BenchScenario* scenario, MapScene* scene, u32 ticks, u32 seed, const char* mapfile, const char* scenariofile, Replay* replay = NULL) {
+	BenchResult result = { 0 };
+	seed_random(seed);
+	Game game = setup_bench_game(scenario, mapfile, scenariofile, replay);
+
+	auto start = std::chrono::steady_clock::now();
+	for (u32 tick = 0; tick < ticks; ++tick) {
+		profile_begin_frame();
+		update_game(&game, scene);
+		if (replay != NULL)
+			apply_commands(&game, scene, replay);
+		profile_end_frame();
+
+		for (u32 i = 0; i < get_profile_node_count(); ++i) {
+			ProfileNode* node = get_profile_node(i);
+			for (u32 p = 0; p < BENCH_NUM_PHASES; ++p) {
+				if (strcmp(node->name, PHASES[p]) == 0) {
+					result.phaseMs[p] += node->ms;
+					if (node->ms > result.phaseMaxMs[p])
+						result.phaseMaxMs[p] = node->ms;
+				}
+			}
+		}
+
+		result.peakUnits = std::max(result.peakUnits, (u32)game.map.units.size());
+		result.peakProjectiles = std::max(result.peakProjectiles, (u32)game.map.projectiles.size());
+		result.peakExplosions = std::max(result.peakExplosions, (u32)game.map.explosions.size());
+	}
+	result.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+	result.wave = game.currentWave;
+	result.money = game.money;
+	result.unitsLeft = game.map.units.size();
+	for (u32 i = 0; i < game.map.goldpiles.size(); ++i)
+		result.coinsLeft += game.map.goldpiles[i].coins;
+	dispose_map(&game.map);
+	return result;
+}
+
+static inline
+void print_result(BenchScenario* scenario, BenchResult* result, u32 ticks) {
+	printf("%-14s %5d invaders %5d turrets %4dx%-4d | %6d ticks %8.1f ticks/s | peak %6d units %5d projectiles %4d explosions\n",
+		scenario->name, scenario->invaders, scenario->turrets, scenario->width, scenario->height,
+		ticks, ticks / result->seconds, result->peakUnits, result->peakProjectiles, result->peakExplosions);
+	for (u32 p = 0; p < BENCH_NUM_PHASES; ++p)
+		printf("    %-12s avg %8.3f ms   max %8.3f ms\n", PHASES[p], result->phaseMs[p] / ticks, result->phaseMaxMs[p]);
+	printf("    end          wave %d   money %d   coins left %d   units left %d\n", result->wave, result->money, result->coinsLeft, result->unitsLeft);
+}
+
+static inline
+void write_csv_row(FILE* file, BenchScenario* scenario, BenchResult* result, u32 ticks, u32 seed) {
+	fprintf(file, "%s,%d,%d,%d,%d,%d,%d,%d,%.3f,%.1f,%d,%d,%d,%d,%d,%d,%d", scenario->name, scenario->invaders, scenario->turrets,
+		scenario->width, scenario->height, ticks, seed, get_job_worker_count(), result->seconds, ticks / result->seconds,
+		result->peakUnits, result->peakProjectiles, result->peakExplosions,
+		result->wave, result->money, result->coinsLeft, result->unitsLeft);
+	for (u32 p = 0; p < BENCH_NUM_PHASES; ++p)
+		fprintf(file, ",%.4f", result->phaseMs[p] / ticks);
+	fprintf(file, "\n");
+}
+
+int main(int argc, char** argv) {
+	const char* only = "all";
+	const char* mapfile = NULL;
+	const char* scenariofile = NULL;
+	const char* replayfile = NULL;
+	const char* csvfile = NULL;
+	u32 ticks = 0;
+	u32 seed = 1;
+	u32 workers = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+			ticks = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+			mapfile = argv[++i];
+		else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc)
+			scenariofile = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayfile = argv[++i];
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvfile = argv[++i];
+		else if (strcmp(argv[i], "--no-lod") == 0)
+			unitLOD = false;
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+			workers = atoi(argv[++i]);
+		else
+			only = argv[i];
+	}
+
+	//the per-tick trace would only be overwritten, so leave it off unless asked for
+	set_trace_enabled(false);
+	MapScene scene = load_headless_scene();
+	if (workers > 0)
+		init_jobs(workers);
+
+	FILE* csv = NULL;
+	if (csvfile != NULL) {
+		csv = fopen(csvfile, "a");
+		if (csv == NULL)
+			BMT_LOG(FATAL_ERROR, "[%s] Could not open the csv file", csvfile);
+		//a new file gets a header row, so results from many runs can be appended to one file
+		fseek(csv, 0, SEEK_END);
+		if (ftell(csv) == 0) {
+			fprintf(csv, "scenario,invaders,turrets,width,height,ticks,seed,workers,seconds,ticks_per_second,peak_units,peak_projectiles,peak_explosions,wave,money,coins_left,units_left");
+			for (u32 p = 0; p < BENCH_NUM_PHASES; ++p)
+				fprintf(csv, ",%s_ms", PHASES[p]);
+			fprintf(csv, "\n");
+		}
+	}
+
+	if (replayfile != NULL) {
+		Replay replay = { 0 };
+		if (!load_replay(&replay, replayfile))
+			return 1;
+		BenchScenario custom = { replayfile, 0, 0, 0, 0, replay.ticks };
+		u32 replayTicks = ticks != 0 ? ticks : custom.ticks;
+		BenchResult result = run_scenario(&custom, &scene, replayTicks, replay.seed, NULL, NULL, &replay);
+		print_result(&custom, &result, replayTicks);
+		if (csv != NULL) {
+			write_csv_row(csv, &custom, &result, replayTicks, replay.seed);
+			fclose(csv);
+		}
+		return 0;
+	}
+
+	if (scenariofile != NULL) {
+		//invaders counts boats here, which is what the file describes
+		BenchScenario custom = { scenariofile, 0, 0, 0, 0, 1000 };
+		u32 scenarioTicks = ticks != 0 ? ticks : custom.ticks;
+		BenchResult result = run_scenario(&custom, &scene, scenarioTicks, seed, NULL, scenariofile);
+		print_result(&custom, &result, scenarioTicks);
+		if (csv != NULL) {
+			write_csv_row(csv, &custom, &result, scenarioTicks, seed);
+			fclose(csv);
+		}
+		return 0;
+	}
+
+	bool found = false;
+	for (u32 i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); ++i) {
+		BenchScenario* scenario = &SCENARIOS[i];
+		if (strcmp(only, "all") != 0 && strcmp(only, scenario->name) != 0)
+			continue;
+		found = true;
+
+		u32 scenarioTicks = ticks != 0 ? ticks : scenario->ticks;
+		BenchResult result = run_scenario(scenario, &scene, scenarioTicks, seed, mapfile, NULL);
+		print_result(scenario, &result, scenarioTicks);
+		if (csv != NULL)
+			write_csv_row(csv, scenario, &result, scenarioTicks, seed);
+	}
+
+	if (csv != NULL)
+		fclose(csv);
+
+	if (!found) {
+		printf("unknown scenario '%s', expected 'all' or one of:\n", only);
+		for (u32 i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); ++i)
+			printf("    %s\n", SCENARIOS[i].name);
+		return 1;
+	}
+	return 0;
+}
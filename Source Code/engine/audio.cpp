@@ -28,6 +28,7 @@
 
 #include <string.h>
 #include "audio.h"
+#include "trace.h"
 
 GLOBAL u8 masterVolume;
 GLOBAL ALCcontext* context;
@@ -150,6 +151,7 @@ u8 get_master_volume() {
 }
 
 Sound load_sound(const char* filename) {
+	TRACE_SCOPE(trace_intern(filename));
 	Sound sound = { 0 };
 	SoundData data = { 0 };
 
@@ -31,10 +31,15 @@
 
 #include "audio.h"
 #include "defines.h"
+#include "filemap.h"
+#include "glstate.h"
+#include "jobs.h"
 #include "maths.h"
+#include "profiler.h"
 #include "render2D.h"
 #include "shader.h"
 #include "texture.h"
+#include "trace.h"
 #include "window.h"
 #include "font.h"
 
@@ -46,7 +46,7 @@
 #define LOCAL static
 #define GLOBAL static
 #define EXTERNAL   extern
-#define MAX_FORMAT_TEXT_SIZE 128
+#define MAX_FORMAT_TEXT_SIZE 512
 
 #define BMT_TO_STRING(x) #x
 #define BMT_STRING_APPEND(str1, str2) str1 ## str2
@@ -240,6 +240,30 @@ GLchar* read_file(const GLchar* filename) {
 	return data;
 }
 
+//Looks up GL entry points the loader doesn't cover. This is GLFW's unless the context was made
+//some other way, like the EGL context in the render benchmark, which sets it before creating batches.
+GLOBAL GLADloadproc bmtGetProcAddress = (GLADloadproc)glfwGetProcAddress;
+
+INTERNAL inline
+bool gl_version_at_least(i32 major, i32 minor) {
+	GLint glmajor = 0;
+	GLint glminor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &glmajor);
+	glGetIntegerv(GL_MINOR_VERSION, &glminor);
+	return glmajor > major || (glmajor == major && glminor >= minor);
+}
+
+INTERNAL inline
+bool has_gl_extension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	}
+	return false;
+}
+
 //Altered GLFW3 #defines to remove the GLFW_ and make it less verbose to type.
 //Original written by Marcus Geelnard and Camilla Berglund
 
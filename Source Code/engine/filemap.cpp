@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                      filemap.cpp                                //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include "filemap.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+
+bool map_file(const char* filename, MappedFile* file) {
+	*file = { 0 };
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	//the mapping object keeps the file open, so only it needs to be kept
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(handle);
+	if (mapping == NULL)
+		return false;
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	file->data = (u8*)data;
+	file->size = size.QuadPart;
+	file->handle = mapping;
+	return true;
+}
+
+void unmap_file(MappedFile* file) {
+	if (file->data != NULL) {
+		UnmapViewOfFile(file->data);
+		CloseHandle((HANDLE)file->handle);
+	}
+	*file = { 0 };
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool map_file(const char* filename, MappedFile* file) {
+	*file = { 0 };
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	//a private mapping stays valid after the descriptor is closed
+	void* data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	file->data = (u8*)data;
+	file->size = info.st_size;
+	return true;
+}
+
+void unmap_file(MappedFile* file) {
+	if (file->data != NULL)
+		munmap(file->data, file->size);
+	*file = { 0 };
+}
+
+#endif
@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                      filemap.h                                  //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include "defines.h"
+
+//==========================================================================================
+//Description: A whole file mapped into memory, read only on disk but copy on write in
+//			   memory, so callers can point straight into it and still modify what they
+//			   point at without touching the file.
+//
+//Comments: Pages are only read from disk when first touched. The mapping stays valid
+//			until unmap_file(), so anything pointing into data must be done with first.
+//==========================================================================================
+struct MappedFile {
+	u8* data;
+	u64 size;
+	void* handle;
+};
+
+bool map_file(const char* filename, MappedFile* file);
+void unmap_file(MappedFile* file);
+
+#endif
@@ -87,10 +87,12 @@ Texture create_texture_from_string(Font& font, const std::string str, i32 texPar
 	tex.width = w;
 	tex.height = h;
 	tex.flip_flag = 0;
+	tex.layer = 0;
+	tex.array = 0;
 
-	glActiveTexture(GL_TEXTURE0);
+	gl_active_texture(0);
 	glGenTextures(1, &tex.ID);
-	glBindTexture(GL_TEXTURE_2D, tex.ID);
+	gl_bind_texture(GL_TEXTURE_2D, tex.ID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
 	//blank texture
@@ -147,7 +149,7 @@ Texture create_texture_from_string(Font& font, const std::string str, i32 texPar
 		delete[] pixels;
 	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	return tex;
 }
@@ -187,12 +189,14 @@ Font load_font(const GLchar* filepath, unsigned int size, i32 texParam) {
 		Character* character = new Character;
 
 		glGenTextures(1, &character->texture.ID);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, character->texture.ID);
+		gl_active_texture(0);
+		gl_bind_texture(GL_TEXTURE_2D, character->texture.ID);
 
 		character->texture.width = font.face->glyph->bitmap.width;
 		character->texture.height = font.face->glyph->bitmap.rows;
 		character->texture.flip_flag = 0;
+		character->texture.layer = 0;
+		character->texture.array = 0;
 
 		GLubyte* glyphPixels = font.face->glyph->bitmap.buffer;
 
@@ -213,7 +217,7 @@ Font load_font(const GLchar* filepath, unsigned int size, i32 texParam) {
 		);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texParam);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texParam);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		gl_bind_texture(GL_TEXTURE_2D, 0);
 
 		character->size = V2((float)font.face->glyph->bitmap.width, (float)font.face->glyph->bitmap.rows);
 		character->bearing = V2((float)font.face->glyph->bitmap_left, (float)font.face->glyph->bitmap_top);
@@ -266,7 +270,7 @@ const char* format_text(const char* text, ...) {
 
 	va_list args;
 	va_start(args, text);
-	vsprintf(buffer, text, args);
+	vsnprintf(buffer, MAX_FORMAT_TEXT_SIZE, text, args);
 	va_end(args);
 
 	return buffer;
@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       glstate.h                                 //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include "defines.h"
+
+//==========================================================================================
+//Description: Remembers the GL state the engine last set so that calls which would not
+//			   change anything never reach the driver.
+//
+//Comments: Everything starts out unknown, so the first call for each piece of state always
+//			goes through. Any code that changes this state with raw GL calls must call
+//			reset_gl_state_cache() afterwards, or the cache will skip calls it shouldn't.
+//==========================================================================================
+#define GLSTATE_MAX_TEXTURE_UNITS	32
+#define GLSTATE_UNKNOWN				0xFFFFFFFF
+
+struct GLStateCache {
+	GLuint program;
+	GLuint vao;
+	GLuint arraybuffer;
+	u32 activeunit;
+	GLuint textures[GLSTATE_MAX_TEXTURE_UNITS];
+	GLuint texturearrays[GLSTATE_MAX_TEXTURE_UNITS];
+	u32 blending;
+	u32 depthTest;
+};
+
+INTERNAL inline
+GLStateCache create_gl_state_cache() {
+	GLStateCache cache;
+	memset(&cache, 0xFF, sizeof(GLStateCache));
+	return cache;
+}
+
+GLOBAL GLStateCache glstate = create_gl_state_cache();
+
+INTERNAL inline
+void reset_gl_state_cache() {
+	glstate = create_gl_state_cache();
+}
+
+INTERNAL inline
+void gl_use_program(GLuint program) {
+	if (glstate.program == program)
+		return;
+	glUseProgram(program);
+	glstate.program = program;
+}
+
+INTERNAL inline
+void gl_bind_vertex_array(GLuint vao) {
+	if (glstate.vao == vao)
+		return;
+	glBindVertexArray(vao);
+	glstate.vao = vao;
+}
+
+INTERNAL inline
+void gl_bind_array_buffer(GLuint buffer) {
+	if (glstate.arraybuffer == buffer)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glstate.arraybuffer = buffer;
+}
+
+INTERNAL inline
+void gl_active_texture(u32 unit) {
+	if (glstate.activeunit == unit)
+		return;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glstate.activeunit = unit;
+}
+
+//==========================================================================================
+//Description: Binds a texture to the active unit
+//
+//Parameters: 
+//		-GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+//		-The texture to bind, or 0 to unbind
+//==========================================================================================
+INTERNAL inline
+void gl_bind_texture(GLenum target, GLuint texture) {
+	u32 unit = glstate.activeunit;
+	if (unit >= GLSTATE_MAX_TEXTURE_UNITS) {
+		glBindTexture(target, texture);
+		return;
+	}
+
+	GLuint* bound = target == GL_TEXTURE_2D_ARRAY ? &glstate.texturearrays[unit] : &glstate.textures[unit];
+	if (*bound == texture)
+		return;
+	glBindTexture(target, texture);
+	*bound = texture;
+}
+
+INTERNAL inline
+void gl_bind_texture(GLenum target, GLuint texture, u32 unit) {
+	if (unit < GLSTATE_MAX_TEXTURE_UNITS) {
+		GLuint bound = target == GL_TEXTURE_2D_ARRAY ? glstate.texturearrays[unit] : glstate.textures[unit];
+		if (bound == texture)
+			return;
+	}
+	gl_active_texture(unit);
+	gl_bind_texture(target, texture);
+}
+
+INTERNAL inline
+void gl_set_blending(bool enabled) {
+	if (glstate.blending == (u32)enabled)
+		return;
+	if (enabled)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+	glstate.blending = enabled;
+}
+
+INTERNAL inline
+void gl_set_depth_test(bool enabled) {
+	if (glstate.depthTest == (u32)enabled)
+		return;
+	if (enabled)
+		glEnable(GL_DEPTH_TEST);
+	else
+		glDisable(GL_DEPTH_TEST);
+	glstate.depthTest = enabled;
+}
+
+//deleting a bound object unbinds it, so the cache has to forget it too or a new object
+//that reuses the name would be mistaken for one that is already bound.
+INTERNAL inline
+void gl_forget_texture(GLuint texture) {
+	for (u32 i = 0; i < GLSTATE_MAX_TEXTURE_UNITS; ++i) {
+		if (glstate.textures[i] == texture)
+			glstate.textures[i] = 0;
+		if (glstate.texturearrays[i] == texture)
+			glstate.texturearrays[i] = 0;
+	}
+}
+
+INTERNAL inline
+void gl_forget_vertex_array(GLuint vao) {
+	if (glstate.vao == vao)
+		glstate.vao = 0;
+}
+
+INTERNAL inline
+void gl_forget_array_buffer(GLuint buffer) {
+	if (glstate.arraybuffer == buffer)
+		glstate.arraybuffer = 0;
+}
+
+INTERNAL inline
+void gl_forget_program(GLuint program) {
+	//a deleted program stays in use until something else is, so only a later glUseProgram
+	//with a recycled name would be skipped wrongly
+	if (glstate.program == program)
+		glstate.program = GLSTATE_UNKNOWN;
+}
+
+#endif
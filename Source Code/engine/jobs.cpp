@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       jobs.cpp                                  //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "jobs.h"
+#include "trace.h"
+
+struct JobQueue {
+	std::mutex mutex;
+	u32 top;		//thieves take the oldest job from here
+	u32 bottom;		//the owning thread pushes and pops the newest job here
+	Job jobs[JOBS_QUEUE_SIZE];
+};
+
+//queue 0 belongs to the main thread, and to any other thread that is not a worker
+GLOBAL JobQueue queues[JOBS_MAX_WORKERS + 1];
+GLOBAL std::thread workers[JOBS_MAX_WORKERS];
+GLOBAL u32 workerCount;
+GLOBAL std::atomic<i32> queuedJobs(0);
+GLOBAL std::atomic<bool> jobsRunning(false);
+GLOBAL std::mutex sleepMutex;
+GLOBAL std::condition_variable sleepCondition;
+
+GLOBAL thread_local u32 queueIndex;
+
+INTERNAL inline
+bool push_job(JobQueue* queue, Job job) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->bottom - queue->top == JOBS_QUEUE_SIZE)
+		return false;
+	queue->jobs[queue->bottom++ & (JOBS_QUEUE_SIZE - 1)] = job;
+	return true;
+}
+
+//used for jobs that are waiting on a dependency, so everything else in the deque runs first
+INTERNAL inline
+bool push_job_front(JobQueue* queue, Job job) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->bottom - queue->top == JOBS_QUEUE_SIZE)
+		return false;
+	queue->jobs[--queue->top & (JOBS_QUEUE_SIZE - 1)] = job;
+	return true;
+}
+
+INTERNAL inline
+bool pop_job(JobQueue* queue, Job* job) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->bottom == queue->top)
+		return false;
+	*job = queue->jobs[--queue->bottom & (JOBS_QUEUE_SIZE - 1)];
+	return true;
+}
+
+INTERNAL inline
+bool steal_job(JobQueue* queue, Job* job) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->bottom == queue->top)
+		return false;
+	*job = queue->jobs[queue->top++ & (JOBS_QUEUE_SIZE - 1)];
+	return true;
+}
+
+INTERNAL inline
+bool get_job(Job* job) {
+	if (queuedJobs.load(std::memory_order_relaxed) <= 0)
+		return false;
+
+	bool found = pop_job(&queues[queueIndex], job);
+	for (u32 i = 1; i <= workerCount && !found; ++i)
+		found = steal_job(&queues[(queueIndex + i) % (workerCount + 1)], job);
+
+	if (found)
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	return found;
+}
+
+INTERNAL inline
+void wake_workers(bool all) {
+	//taking the lock means a worker cannot miss the wake up between checking for jobs and sleeping
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	if (all)
+		sleepCondition.notify_all();
+	else
+		sleepCondition.notify_one();
+}
+
+INTERNAL inline
+bool submit_job(Job job) {
+	if (!push_job(&queues[queueIndex], job))
+		return false;
+	queuedJobs.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+INTERNAL inline
+void execute_job(Job job) {
+	if (job.dependency != NULL && job.dependency->pending.load(std::memory_order_acquire) != 0) {
+		//not ready yet, so put it back behind the other jobs and look for other work first
+		if (push_job_front(&queues[queueIndex], job)) {
+			queuedJobs.fetch_add(1, std::memory_order_relaxed);
+			std::this_thread::yield();
+			return;
+		}
+		wait_for_counter(job.dependency);
+	}
+
+	{
+		TRACE_SCOPE("job");
+		job.function(job.data, job.begin, job.end);
+	}
+	if (job.counter != NULL)
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+INTERNAL
+void worker_main(u32 index) {
+	queueIndex = index;
+	char name[32];
+	snprintf(name, sizeof(name), "job worker %u", index);
+	set_trace_thread_name(trace_intern(name));
+
+	while (jobsRunning.load(std::memory_order_acquire)) {
+		Job job;
+		if (get_job(&job)) {
+			execute_job(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		while (queuedJobs.load(std::memory_order_relaxed) <= 0 && jobsRunning.load(std::memory_order_acquire))
+			sleepCondition.wait(lock);
+	}
+}
+
+void init_jobs(u32 numWorkers) {
+	if (workerCount > 0)
+		return;
+	if (numWorkers == 0) {
+		u32 hardwareThreads = std::thread::hardware_concurrency();
+		numWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+	if (numWorkers > JOBS_MAX_WORKERS)
+		numWorkers = JOBS_MAX_WORKERS;
+
+	jobsRunning.store(true, std::memory_order_release);
+	workerCount = numWorkers;
+	for (u32 i = 0; i < numWorkers; ++i)
+		workers[i] = std::thread(worker_main, i + 1);
+
+	//a program that returns from main without dispose_jobs would otherwise abort on the
+	//still joinable threads
+	LOCAL bool registered = false;
+	if (!registered && numWorkers > 0)
+		registered = atexit(dispose_jobs) == 0;
+}
+
+void dispose_jobs() {
+	if (workerCount == 0)
+		return;
+
+	jobsRunning.store(false, std::memory_order_release);
+	wake_workers(true);
+	for (u32 i = 0; i < workerCount; ++i)
+		workers[i].join();
+
+	//anything still queued runs here, so no counter is left waiting forever
+	u32 numQueues = workerCount + 1;
+	workerCount = 0;
+	for (u32 i = 0; i < numQueues; ++i) {
+		Job job;
+		while (steal_job(&queues[i], &job)) {
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			execute_job(job);
+		}
+	}
+}
+
+u32 get_job_worker_count() {
+	return workerCount;
+}
+
+void run_job(Job job) {
+	if (job.counter != NULL)
+		job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	if (submit_job(job)) {
+		if (workerCount > 0)
+			wake_workers(false);
+	}
+	else {
+		//the deque is full, so the job runs now instead
+		if (job.dependency != NULL)
+			wait_for_counter(job.dependency);
+		execute_job(job);
+	}
+}
+
+void wait_for_counter(JobCounter* counter) {
+	while (counter->pending.load(std::memory_order_acquire) != 0) {
+		Job job;
+		if (get_job(&job))
+			execute_job(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void parallel_for(u32 count, u32 grainSize, JobFunction function, void* data, JobCounter* dependency) {
+	if (count == 0)
+		return;
+	if (grainSize == 0)
+		grainSize = 1;
+
+	if (workerCount == 0 || count <= grainSize) {
+		if (dependency != NULL)
+			wait_for_counter(dependency);
+		function(data, 0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (u32 begin = 0; begin < count; begin += grainSize) {
+		Job job = { function, data, begin, std::min(begin + grainSize, count), &counter, dependency };
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		if (!submit_job(job)) {
+			if (dependency != NULL)
+				wait_for_counter(dependency);
+			execute_job(job);
+		}
+	}
+	wake_workers(true);
+	wait_for_counter(&counter);
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       jobs.h                                    //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include "defines.h"
+
+#define JOBS_MAX_WORKERS	31
+#define JOBS_QUEUE_SIZE		1024 //jobs each thread's deque holds; must be a power of two
+
+typedef void (*JobFunction)(void* data, u32 begin, u32 end);
+
+//counts the jobs that have been started with it and have not finished yet
+struct JobCounter {
+	std::atomic<u32> pending;
+	JobCounter() : pending(0) {}
+};
+
+struct Job {
+	JobFunction function;
+	void* data;
+	u32 begin;
+	u32 end;
+	JobCounter* counter;		//decremented when the job finishes, can be NULL
+	JobCounter* dependency;		//the job does not start until this reaches zero, can be NULL
+};
+
+//==========================================================================================
+//Description: A work-stealing pool of worker threads. Every worker, and the main thread,
+//			   has its own deque of jobs. A thread pushes and pops jobs at the back of its
+//			   own deque and, when that is empty, steals the oldest job from the front of
+//			   another thread's deque.
+//
+//Comments: Passing 0 workers to init_jobs uses one worker per hardware thread, less the
+//			main thread. A thread waiting on a counter runs jobs while it waits rather
+//			than sleeping, so the main thread is one of the workers in a parallel_for.
+//			Before init_jobs is called, or with no workers, parallel_for runs the whole
+//			range on the calling thread.
+//==========================================================================================
+void init_jobs(u32 numWorkers = 0);
+void dispose_jobs();
+u32 get_job_worker_count();
+void run_job(Job job);
+void wait_for_counter(JobCounter* counter);
+
+//==========================================================================================
+//Description: Splits [0, count) into ranges of at most grainSize indices, runs function on
+//			   each range across the workers and returns once they have all finished.
+//
+//Comments: The ranges run in no particular order and at the same time, so function must
+//			only write to data belonging to its own range.
+//==========================================================================================
+void parallel_for(u32 count, u32 grainSize, JobFunction function, void* data, JobCounter* dependency = NULL);
+
+#endif
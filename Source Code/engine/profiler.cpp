@@ -0,0 +1,200 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       profiler.cpp                              //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <algorithm>
+#include "profiler.h"
+
+typedef std::chrono::high_resolution_clock ProfileClock;
+
+GLOBAL ProfileNode nodes[PROFILE_MAX_NODES];
+GLOBAL u32 nodeCount;
+
+//the scopes that are currently open, innermost last
+GLOBAL i32 stack[PROFILE_MAX_DEPTH];
+GLOBAL ProfileClock::time_point stackStart[PROFILE_MAX_DEPTH];
+GLOBAL u32 stackDepth;
+//scopes opened past PROFILE_MAX_DEPTH or PROFILE_MAX_NODES are not timed, but still need to be closed
+GLOBAL u32 untracked;
+
+GLOBAL u32 frameCount;
+
+INTERNAL inline
+i32 find_or_add_node(const char* name, i32 parent) {
+	for (u32 i = 0; i < nodeCount; ++i) {
+		if (nodes[i].parent == parent && (nodes[i].name == name || strcmp(nodes[i].name, name) == 0))
+			return i;
+	}
+	if (nodeCount >= PROFILE_MAX_NODES)
+		return -1;
+
+	ProfileNode* node = &nodes[nodeCount];
+	memset(node, 0, sizeof(ProfileNode));
+	node->name = name;
+	node->parent = parent;
+	node->depth = parent < 0 ? 0 : nodes[parent].depth + 1;
+	return nodeCount++;
+}
+
+void profile_begin(const char* name) {
+	if (untracked > 0 || stackDepth >= PROFILE_MAX_DEPTH) {
+		untracked++;
+		return;
+	}
+
+	i32 parent = stackDepth == 0 ? -1 : stack[stackDepth - 1];
+	i32 node = find_or_add_node(name, parent);
+	if (node < 0) {
+		untracked++;
+		return;
+	}
+
+	stack[stackDepth] = node;
+	stackStart[stackDepth] = ProfileClock::now();
+	stackDepth++;
+}
+
+void profile_end() {
+	if (untracked > 0) {
+		untracked--;
+		return;
+	}
+	if (stackDepth == 0)
+		return;
+
+	stackDepth--;
+	ProfileNode* node = &nodes[stack[stackDepth]];
+	node->ms += std::chrono::duration<f64, std::milli>(ProfileClock::now() - stackStart[stackDepth]).count();
+	node->calls++;
+}
+
+void profile_begin_frame() {
+	for (u32 i = 0; i < nodeCount; ++i) {
+		nodes[i].ms = 0;
+		nodes[i].calls = 0;
+	}
+	stackDepth = 0;
+	untracked = 0;
+	profile_begin("frame");
+}
+
+void profile_end_frame() {
+	//close anything left open, such as a scope that was returned out of without its destructor
+	while (stackDepth > 0 || untracked > 0)
+		profile_end();
+
+	u32 slot = frameCount % PROFILE_HISTORY;
+	for (u32 i = 0; i < nodeCount; ++i)
+		nodes[i].history[slot] = (f32)nodes[i].ms;
+	frameCount++;
+}
+
+u32 get_profile_node_count() {
+	return nodeCount;
+}
+
+ProfileNode* get_profile_node(u32 index) {
+	return &nodes[index];
+}
+
+u32 get_profile_frame_count() {
+	return frameCount;
+}
+
+INTERNAL inline
+void add_subtree(i32 parent, u32* order, u32* count) {
+	for (u32 i = 0; i < nodeCount; ++i) {
+		if (nodes[i].parent == parent) {
+			order[(*count)++] = i;
+			add_subtree(i, order, count);
+		}
+	}
+}
+
+u32 get_profile_tree_order(u32 order[PROFILE_MAX_NODES]) {
+	u32 count = 0;
+	add_subtree(-1, order, &count);
+	return count;
+}
+
+//==========================================================================================
+//Description: Returns the last frame's time for a node along with the min, average and
+//			   99th percentile over the rolling history.
+//
+//Comments: Frames from before a node was first seen count as 0ms.
+//==========================================================================================
+ProfileStats get_profile_stats(u32 index) {
+	ProfileStats stats = { 0 };
+	if (index >= nodeCount || frameCount == 0)
+		return stats;
+
+	u32 count = frameCount < PROFILE_HISTORY ? frameCount : PROFILE_HISTORY;
+	f32 sorted[PROFILE_HISTORY];
+	memcpy(sorted, nodes[index].history, count * sizeof(f32));
+	std::sort(sorted, sorted + count);
+
+	f32 total = 0;
+	for (u32 i = 0; i < count; ++i)
+		total += sorted[i];
+
+	stats.last = nodes[index].history[(frameCount - 1) % PROFILE_HISTORY];
+	stats.min = sorted[0];
+	stats.avg = total / count;
+	stats.p99 = sorted[(u32)((count - 1) * 0.99f)];
+	return stats;
+}
+
+bool export_profile_csv(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Could not open file to write the profile", filename);
+		return false;
+	}
+
+	u32 order[PROFILE_MAX_NODES];
+	u32 count = get_profile_tree_order(order);
+
+	fprintf(file, "scope,depth,calls,last_ms,min_ms,avg_ms,p99_ms\n");
+	for (u32 o = 0; o < count; ++o) {
+		u32 i = order[o];
+		//write the full path so rows with the same name under different parents stay distinct
+		const char* path[PROFILE_MAX_NODES];
+		u32 length = 0;
+		for (i32 n = i; n >= 0; n = nodes[n].parent)
+			path[length++] = nodes[n].name;
+		for (u32 p = length; p > 0; --p)
+			fprintf(file, p == length ? "%s" : "/%s", path[p - 1]);
+
+		ProfileStats stats = get_profile_stats(i);
+		fprintf(file, ",%d,%d,%.4f,%.4f,%.4f,%.4f\n", nodes[i].depth, nodes[i].calls, stats.last, stats.min, stats.avg, stats.p99);
+	}
+
+	fclose(file);
+	BMT_LOG(INFO, "[%s] Profile exported (%d frames)", filename, frameCount < PROFILE_HISTORY ? frameCount : PROFILE_HISTORY);
+	return true;
+}
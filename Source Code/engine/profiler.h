@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       profiler.h                                //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "defines.h"
+#include "trace.h"
+
+#define PROFILE_MAX_NODES	128
+#define PROFILE_MAX_DEPTH	16
+#define PROFILE_HISTORY		240 //frames kept for the rolling min/avg/p99
+
+//==========================================================================================
+//Description: One named scope in the frame tree. A scope opened under the same parent with
+//			   the same name shares a node, so a scope that runs many times a frame (like
+//			   a batch flush) adds up into one entry.
+//==========================================================================================
+struct ProfileNode {
+	const char* name;
+	i32 parent;
+	u16 depth;
+	u32 calls;		//times the scope was entered this frame
+	f64 ms;			//total time spent in the scope this frame
+	f32 history[PROFILE_HISTORY];
+};
+
+struct ProfileStats {
+	f32 last;
+	f32 min;
+	f32 avg;
+	f32 p99;
+};
+
+void profile_begin(const char* name);
+void profile_end();
+void profile_begin_frame();
+void profile_end_frame();
+
+u32 get_profile_node_count();
+ProfileNode* get_profile_node(u32 index);
+ProfileStats get_profile_stats(u32 index);
+u32 get_profile_frame_count();
+//fills order with node indices so that every node comes right before its children
+u32 get_profile_tree_order(u32 order[PROFILE_MAX_NODES]);
+
+bool export_profile_csv(const char* filename);
+
+struct ProfileScope {
+	ProfileScope(const char* name) { profile_begin(name); }
+	~ProfileScope() { profile_end(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+//times everything from here to the end of the enclosing block, and records it in the trace
+#if defined(BMT_NO_PROFILE)
+#define PROFILE_SCOPE(name) TRACE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name); TRACE_SCOPE(name)
+#endif
+
+#endif
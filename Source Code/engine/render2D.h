@@ -30,10 +30,39 @@
 #define RENDER2D_H
 
 #include "defines.h"
+#include "profiler.h"
 #include "shader.h"
 #include "texture.h"
 #include "font.h"
 
+//Sync objects are core in GL 3.2 (or GL_ARB_sync), but the loader only covers 3.1 and we create a
+//3.0 context, so the entry points are fetched by hand when a ring-streamed batch is created.
+#define BMT_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define BMT_ALREADY_SIGNALED			0x911A
+#define BMT_TIMEOUT_EXPIRED				0x911B
+#define BMT_CONDITION_SATISFIED			0x911C
+#define BMT_WAIT_FAILED					0x911D
+#define BMT_SYNC_FLUSH_COMMANDS_BIT		0x00000001
+
+typedef struct __GLsync* (APIENTRYP BMTFENCESYNCPROC)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP BMTCLIENTWAITSYNCPROC)(struct __GLsync* sync, GLbitfield flags, u64 timeout);
+typedef void (APIENTRYP BMTDELETESYNCPROC)(struct __GLsync* sync);
+
+GLOBAL BMTFENCESYNCPROC bmtFenceSync;
+GLOBAL BMTCLIENTWAITSYNCPROC bmtClientWaitSync;
+GLOBAL BMTDELETESYNCPROC bmtDeleteSync;
+
+INTERNAL inline
+bool load_sync_functions() {
+	if (!gl_version_at_least(3, 2) && !has_gl_extension("GL_ARB_sync"))
+		return false;
+
+	bmtFenceSync = (BMTFENCESYNCPROC)bmtGetProcAddress("glFenceSync");
+	bmtClientWaitSync = (BMTCLIENTWAITSYNCPROC)bmtGetProcAddress("glClientWaitSync");
+	bmtDeleteSync = (BMTDELETESYNCPROC)bmtGetProcAddress("glDeleteSync");
+	return bmtFenceSync != NULL && bmtClientWaitSync != NULL && bmtDeleteSync != NULL;
+}
+
 struct VertexData {
 	vec2 pos;
 	vec4 color; //32 bit color (8 for R, 8 for G, 8 for B, 8 for A)
@@ -51,61 +80,146 @@ struct VertexData {
 #define BATCH_INDICE_SIZE	    BATCH_MAX_SPRITES * 6
 #define BATCH_MAX_TEXTURES		16
 
+#ifndef BATCH_RING_REGIONS
+#define BATCH_RING_REGIONS		3
+#endif
+
+//how long begin2D waits on a region's fence before checking again, in nanoseconds
+#define BATCH_FENCE_TIMEOUT		1000000
+
+enum BatchStreaming {
+	BATCH_STREAM_ORPHAN,
+	BATCH_STREAM_RING
+};
+
+//how many different textures a frame can use before uniqueTextures stops counting new ones
+#define BATCH_MAX_FRAME_TEXTURES	256
+
+struct RenderStats {
+	u32 sprites;
+	u32 drawCalls;
+	u32 textureFlushes; //mid-frame flushes because all 16 texture slots were taken (or the texture array changed)
+	u32 bufferFlushes;  //mid-frame flushes because the vertex buffer (or what was left of a ring region) was full
+	u32 uniqueTextures;
+	u64 bytesUploaded;
+	u32 culled;         //sprites the caller skipped as off screen, reported through add_culled_sprites()
+};
+
+//Timer queries are core in GL 3.3 (or GL_ARB_timer_query), which the loader doesn't cover.
+//The query functions themselves are GL 1.5, so only the target needs defining.
+#define BMT_TIME_ELAPSED			0x88BF
+
+//frames of query objects kept in flight, so results are read back this many frames late
+#ifndef GPU_TIMER_FRAMES
+#define GPU_TIMER_FRAMES			4
+#endif
+//flushes per frame that get timed; any past this are drawn untimed
+#define GPU_TIMER_MAX_QUERIES		64
+
+struct GpuTimings {
+	f32 frameMs; //all timed flushes of the frame added together
+	u32 flushCount;
+	f32 flushMs[GPU_TIMER_MAX_QUERIES];
+	u32 dropped; //frames whose results were not ready in time and were thrown away rather than waited on
+};
+
+struct GpuTimer {
+	bool supported;
+	u32 frame; //the set of queries being recorded this frame
+	u32 queries[GPU_TIMER_FRAMES][GPU_TIMER_MAX_QUERIES];
+	u32 used[GPU_TIMER_FRAMES];
+	GpuTimings last;
+};
+
 struct RenderBatch {
-	u32 vao;
+	u32 vaos[BATCH_RING_REGIONS]; //only the first is used unless streaming is BATCH_STREAM_RING
 	u32 vbo;
 	u32 ebo;
-	u16 indexcount;
+	u32 indexcount;
+	u32 spritecount; //sprites written into the currently mapped buffer
 	u16 texcount;
+	bool blending;
+	bool depthTest;
 	GLuint  textures[BATCH_MAX_TEXTURES];
-	GLchar* locations[BATCH_MAX_TEXTURES];
+	GLuint  texarray; //non-zero when the batch was started with begin2D_array()
+	BatchStreaming streaming;
+	u32 region;
+	u32 regionOffset; //sprites already in the current ring region from earlier flushes
+	struct __GLsync* fences[BATCH_RING_REGIONS]; //set when a region fills up, waited on before writing it again
 	VertexData* buffer;
 	Shader shader;
+	RenderStats stats;     //the frame being drawn
+	RenderStats lastStats; //the last finished frame
+	GLuint frameTextures[BATCH_MAX_FRAME_TEXTURES];
+	GpuTimer gpu;
 };
 
 void end2D(RenderBatch* batch);
 
+//==========================================================================================
+//Description: Sets up the vertex array for one region of the batch's vertex buffer.
+//
+//Comments: Each region gets its own vertex array rather than using a base vertex draw,
+//			since glDrawElementsBaseVertex is not available in the GL 3.0 context we create.
+//			Flushes that start partway into a region draw from the same distance into the
+//			index buffer instead, since the indices repeat the same pattern for every sprite.
+//==========================================================================================
 INTERNAL inline
-RenderBatch create_batch() {
-	RenderBatch batch = { 0 };
+void setup_batch_region(RenderBatch* batch, u32 region) {
+	GLintptr base = region * BATCH_BUFFER_SIZE;
 
-	for (u32 i = 0; i < BATCH_MAX_TEXTURES; ++i)
-		batch.locations[i] = (GLchar*)malloc(6 * sizeof(GLchar));
-
-	strcpy(batch.locations[0], "tex1");
-	strcpy(batch.locations[1], "tex2");
-	strcpy(batch.locations[2], "tex3");
-	strcpy(batch.locations[3], "tex4");
-	strcpy(batch.locations[4], "tex5");
-	strcpy(batch.locations[5], "tex6");
-	strcpy(batch.locations[6], "tex7");
-	strcpy(batch.locations[7], "tex8");
-	strcpy(batch.locations[8], "tex9");
-	strcpy(batch.locations[9], "tex10");
-	strcpy(batch.locations[10], "tex11");
-	strcpy(batch.locations[11], "tex12");
-	strcpy(batch.locations[12], "tex13");
-	strcpy(batch.locations[13], "tex14");
-	strcpy(batch.locations[14], "tex15");
-	strcpy(batch.locations[15], "tex16");
-
-	glGenVertexArrays(1, &batch.vao);
-	glBindVertexArray(batch.vao);
-
-	glGenBuffers(1, &batch.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
-	glBufferData(GL_ARRAY_BUFFER, BATCH_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW);
+	glGenVertexArrays(1, &batch->vaos[region]);
+	gl_bind_vertex_array(batch->vaos[region]);
+	gl_bind_array_buffer(batch->vbo);
 
 	//the last argument to glVertexAttribPointer is the offset from the start of the vertex to the
 	//data you want to look at - so each new attrib adds up all the ones before it.
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)0);                     //vertices
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(2 * sizeof(GLfloat))); //color
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(6 * sizeof(GLfloat))); //tex coords
-	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(8 * sizeof(GLfloat))); //texture id
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(base));                         //vertices
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(base + 2 * sizeof(GLfloat))); //color
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(base + 6 * sizeof(GLfloat))); //tex coords
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(base + 8 * sizeof(GLfloat))); //texture id
+
+	//the vao remembers which attribs are enabled, so they only need enabling once here
+	glEnableVertexAttribArray(0); //position
+	glEnableVertexAttribArray(1); //color
+	glEnableVertexAttribArray(2); //texture coordinates
+	glEnableVertexAttribArray(3); //texture ID
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->ebo);
 
-	GLushort indices[BATCH_INDICE_SIZE];
+	//the vao must be unbound before the element buffer, or it would forget it
+	gl_bind_vertex_array(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-	int offset = 0;
+//==========================================================================================
+//Description: Creates a batch and its GPU buffers
+//
+//Parameters: 
+//		-How vertex data is streamed to the GPU. BATCH_STREAM_ORPHAN maps the whole buffer
+//		 with GL_MAP_INVALIDATE_BUFFER_BIT each begin2D. BATCH_STREAM_RING splits a larger
+//		 buffer into BATCH_RING_REGIONS regions and writes each one unsynchronized. Flushes
+//		 fill a region one after another, and once it is full the batch moves on to the next,
+//		 waiting for the fence set when that one last filled up.
+//
+//Comments: Falls back to BATCH_STREAM_ORPHAN if the driver has no sync objects.
+//==========================================================================================
+INTERNAL inline
+RenderBatch create_batch(BatchStreaming streaming = BATCH_STREAM_ORPHAN) {
+	RenderBatch batch = { 0 };
+
+	if (streaming == BATCH_STREAM_RING && !load_sync_functions()) {
+		BMT_LOG(WARNING, "Sync objects are not supported, batch will orphan its buffer instead of using a ring");
+		streaming = BATCH_STREAM_ORPHAN;
+	}
+	batch.streaming = streaming;
+	u32 regions = streaming == BATCH_STREAM_RING ? BATCH_RING_REGIONS : 1;
+
+	//more than 16384 sprites worth of vertices will not fit in a 16 bit index, so use 32 bit indices.
+	//this is too big for the stack, so it goes on the heap just long enough to be uploaded.
+	GLuint* indices = (GLuint*)malloc(BATCH_INDICE_SIZE * sizeof(GLuint));
+
+	u32 offset = 0;
 	for (u32 i = 0; i < BATCH_INDICE_SIZE; i += 6) {
 		indices[i] = offset + 0;
 		indices[i + 1] = offset + 1;
@@ -117,40 +231,220 @@ RenderBatch create_batch() {
 		offset += 4;
 	}
 
+	//binding the element buffer would attach it to whatever vao is bound
+	gl_bind_vertex_array(0);
 	glGenBuffers(1, &batch.ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, BATCH_INDICE_SIZE * sizeof(GLushort), indices, GL_STATIC_DRAW);
-
-	//the vao must be unbound before the buffers
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, BATCH_INDICE_SIZE * sizeof(GLuint), indices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	free(indices);
+
+	glGenBuffers(1, &batch.vbo);
+	gl_bind_array_buffer(batch.vbo);
+	glBufferData(GL_ARRAY_BUFFER, BATCH_BUFFER_SIZE * regions, NULL, GL_DYNAMIC_DRAW);
+
+	for (u32 i = 0; i < regions; ++i)
+		setup_batch_region(&batch, i);
+
+	batch.gpu.supported = gl_version_at_least(3, 3) || has_gl_extension("GL_ARB_timer_query");
+	if (batch.gpu.supported)
+		glGenQueries(GPU_TIMER_FRAMES * GPU_TIMER_MAX_QUERIES, &batch.gpu.queries[0][0]);
 
 	return batch;
 }
 
+//==========================================================================================
+//Description: Reads back the GPU times of the oldest frame of queries, so they can be
+//			   reused for the frame about to start.
+//
+//Comments: Never waits on the GPU. If the last query of that frame is still not done, the
+//			whole frame is dropped and the previous results are kept.
+//==========================================================================================
+INTERNAL inline
+void read_gpu_timer_frame(GpuTimer* gpu, u32 frame) {
+	u32 used = gpu->used[frame];
+	if (used == 0)
+		return;
+
+	//queries finish in order, so the last one being ready means they all are
+	GLuint available = 0;
+	glGetQueryObjectuiv(gpu->queries[frame][used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		gpu->last.dropped++;
+		return;
+	}
+
+	gpu->last.frameMs = 0;
+	gpu->last.flushCount = used;
+	for (u32 i = 0; i < used; ++i) {
+		GLuint ns = 0;
+		glGetQueryObjectuiv(gpu->queries[frame][i], GL_QUERY_RESULT, &ns);
+		//the 32 bit result saturates, which no real flush comes near. llvmpipe measures the
+		//first query of a context from the driver's start, so this throws that one away.
+		if (ns == 0xFFFFFFFF)
+			ns = 0;
+		gpu->last.flushMs[i] = ns / 1000000.0f;
+		gpu->last.frameMs += gpu->last.flushMs[i];
+	}
+}
+
+//==========================================================================================
+//Description: Ends the current frame's statistics and starts counting a new frame.
+//
+//Comments: Call once per frame, before the first begin2D. get_render_stats() returns the
+//			frame that was just ended.
+//==========================================================================================
+INTERNAL inline
+void reset_render_stats(RenderBatch* batch) {
+	batch->lastStats = batch->stats;
+	batch->stats = { 0 };
+
+	if (batch->gpu.supported) {
+		batch->gpu.frame = (batch->gpu.frame + 1) % GPU_TIMER_FRAMES;
+		read_gpu_timer_frame(&batch->gpu, batch->gpu.frame);
+		batch->gpu.used[batch->gpu.frame] = 0;
+	}
+}
+
+INTERNAL inline
+RenderStats get_render_stats(RenderBatch* batch) {
+	return batch->lastStats;
+}
+
+//returns the GPU time of each flush, from GPU_TIMER_FRAMES - 1 frames ago (all zero if unsupported)
+INTERNAL inline
+GpuTimings get_gpu_timings(RenderBatch* batch) {
+	return batch->gpu.last;
+}
+
+//for code that culls its own sprites, so they show up in the batch's statistics
+INTERNAL inline
+void add_culled_sprites(RenderBatch* batch, u32 count = 1) {
+	batch->stats.culled += count;
+}
+
+INTERNAL inline
+void count_frame_texture(RenderBatch* batch, GLuint id) {
+	u32 count = batch->stats.uniqueTextures;
+	if (count > BATCH_MAX_FRAME_TEXTURES)
+		count = BATCH_MAX_FRAME_TEXTURES;
+	for (u32 i = 0; i < count; ++i) {
+		if (batch->frameTextures[i] == id)
+			return;
+	}
+	if (count < BATCH_MAX_FRAME_TEXTURES)
+		batch->frameTextures[count] = id;
+	batch->stats.uniqueTextures++;
+}
+
 INTERNAL inline
 void begin2D(RenderBatch* batch, Shader shader, bool blending = true, bool depthTest = false) {
 	batch->shader = shader;
+	batch->blending = blending;
+	batch->depthTest = depthTest;
+	batch->texarray = 0;
 	start_shader(shader);
+	gl_set_blending(blending);
+	gl_set_depth_test(depthTest);
+
+	gl_bind_array_buffer(batch->vbo);
+	if (batch->streaming == BATCH_STREAM_RING) {
+		//only write into this region once the GPU has finished drawing what was last in it. The fence
+		//is only there when the region has just been moved on to, earlier flushes into it never wait.
+		struct __GLsync* fence = batch->fences[batch->region];
+		if (fence != NULL) {
+			GLenum result = bmtClientWaitSync(fence, BMT_SYNC_FLUSH_COMMANDS_BIT, BATCH_FENCE_TIMEOUT);
+			while (result == BMT_TIMEOUT_EXPIRED)
+				result = bmtClientWaitSync(fence, 0, BATCH_FENCE_TIMEOUT);
+			bmtDeleteSync(fence);
+			batch->fences[batch->region] = NULL;
+		}
 
-	if (blending)
-		glEnable(GL_BLEND);
-	else
-		glDisable(GL_BLEND);
-	if (depthTest)
-		glEnable(GL_DEPTH_TEST);
-	else
-		glDisable(GL_DEPTH_TEST);
+		//only what is left of the region gets mapped, so the sprites earlier flushes wrote stay as they are
+		batch->buffer = (VertexData*)glMapBufferRange(GL_ARRAY_BUFFER,
+			batch->region * BATCH_BUFFER_SIZE + batch->regionOffset * BATCH_SPRITE_SIZE,
+			(BATCH_MAX_SPRITES - batch->regionOffset) * BATCH_SPRITE_SIZE,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+		);
+	}
+	else {
+		batch->buffer = (VertexData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, BATCH_BUFFER_SIZE,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+		);
+	}
+}
+
+//==========================================================================================
+//Description: Draws everything submitted so far and starts a new batch with the same
+//			   shader, blending and depth state.
+//
+//Comments: Called automatically when the batch runs out of texture slots or sprite space.
+//==========================================================================================
+INTERNAL inline
+void flush_batch(RenderBatch* batch) {
+	GLuint texarray = batch->texarray;
+	end2D(batch);
+	begin2D(batch, batch->shader, batch->blending, batch->depthTest);
+	batch->texarray = texarray;
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
-	batch->buffer = (VertexData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, BATCH_BUFFER_SIZE,
-		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
-	);
+//==========================================================================================
+//Description: Starts a batch that samples every sprite from a single texture array.
+//
+//Parameters: 
+//		-The batch to begin
+//		-A shader from load_array_shader_2D()
+//		-The array whose layers will be drawn
+//
+//Comments: Only textures returned by add_texture_array_layer can be drawn in this batch;
+//			anything else (including text) is skipped with a warning. The layer goes straight to the shader, so there is no 16 texture slot limit
+//			and nothing to re-upload per flush. Drawing a layer of a different array
+//			flushes and switches to that array.
+//==========================================================================================
+INTERNAL inline
+void begin2D_array(RenderBatch* batch, Shader shader, TextureArray arr, bool blending = true, bool depthTest = false) {
+	begin2D(batch, shader, blending, depthTest);
+	batch->texarray = arr.ID;
+	count_frame_texture(batch, arr.ID);
+}
+
+//sprites that still fit before the batch has to flush
+INTERNAL inline
+u32 get_batch_capacity(RenderBatch* batch) {
+	return BATCH_MAX_SPRITES - batch->regionOffset - batch->spritecount;
+}
+
+//==========================================================================================
+//Description: Whether the batch can draw the texture. A batch started with begin2D_array()
+//			   samples only texture array layers, and any other batch only plain textures.
+//
+//Comments: Logs a warning for a texture of the wrong kind, which the caller then skips.
+//==========================================================================================
+INTERNAL inline
+bool batch_accepts_texture(RenderBatch* batch, Texture tex) {
+	if (batch->texarray != 0 && tex.array == 0) {
+		BMT_LOG(WARNING, "Texture #%d is not a texture array layer and can't be drawn in an array batch", tex.ID);
+		return false;
+	}
+	if (batch->texarray == 0 && tex.array != 0) {
+		BMT_LOG(WARNING, "Texture array #%d layer %d can only be drawn in a batch started with begin2D_array", tex.array, tex.layer);
+		return false;
+	}
+	return true;
 }
 
 INTERNAL inline
 i32 submit_tex(RenderBatch* batch, Texture tex) {
+	if (batch->texarray != 0) {
+		if (tex.ID != batch->texarray) {
+			batch->stats.textureFlushes++;
+			flush_batch(batch);
+			batch->texarray = tex.ID;
+			count_frame_texture(batch, tex.ID);
+		}
+		return tex.layer + 1;
+	}
+
 	int texSlot = 0;
 	bool found = false;
 	for (u32 i = 0; i < batch->texcount; ++i) {
@@ -162,20 +456,51 @@ i32 submit_tex(RenderBatch* batch, Texture tex) {
 	}
 	if (!found) {
 		if (batch->texcount >= BATCH_MAX_TEXTURES) {
-			end2D(batch);
-			begin2D(batch, batch->shader);
+			batch->stats.textureFlushes++;
+			flush_batch(batch);
 		}
+		count_frame_texture(batch, tex.ID);
 		batch->textures[batch->texcount++] = tex.ID;
 		texSlot = batch->texcount;
 	}
 	return texSlot;
 }
 
+//==========================================================================================
+//Description: Makes room for one more sprite in the mapped buffer, flushing if it is full.
+//			   The version taking a texture also gives it a slot and returns the slot.
+//
+//Comments: The sprite is only counted once its texture has a slot, since submit_tex can
+//			flush too and a flush starts the count over. Call this before writing the
+//			sprite's vertices.
+//==========================================================================================
+INTERNAL inline
+void reserve_sprite(RenderBatch* batch) {
+	if (get_batch_capacity(batch) == 0) {
+		batch->stats.bufferFlushes++;
+		flush_batch(batch);
+	}
+	batch->spritecount++;
+	batch->stats.sprites++;
+}
+
+INTERNAL inline
+i32 reserve_sprite(RenderBatch* batch, Texture tex) {
+	if (get_batch_capacity(batch) == 0) {
+		batch->stats.bufferFlushes++;
+		flush_batch(batch);
+	}
+	i32 texSlot = submit_tex(batch, tex);
+	batch->spritecount++;
+	batch->stats.sprites++;
+	return texSlot;
+}
+
 INTERNAL inline
 void draw_texture(RenderBatch* batch, Texture tex, i32 xPos, i32 yPos, f32 r, f32 g, f32 b, f32 a) {
-	if (tex.ID == 0)
+	if (tex.ID == 0 || !batch_accepts_texture(batch, tex))
 		return;
-	i32 texSlot = submit_tex(batch, tex);
+	i32 texSlot = reserve_sprite(batch, tex);
 
 	f32 x = (f32)xPos;
 	f32 y = (f32)yPos;
@@ -233,9 +558,9 @@ void draw_texture(RenderBatch* batch, Texture tex, i32 x, i32 y, vec4 rgba) {
 
 INTERNAL inline
 void draw_texture_rotated(RenderBatch* batch, Texture tex, i32 x, i32 y, vec2 origin, f32 rotation, f32 r, f32 g, f32 b, f32 a) {
-	if (tex.ID == 0)
+	if (tex.ID == 0 || !batch_accepts_texture(batch, tex))
 		return;
-	i32 texSlot = submit_tex(batch, tex);
+	i32 texSlot = reserve_sprite(batch, tex);
 
 	LOCAL f32 FLIP_VER_UVS[8] = { 0, 1, 0, 0, 1, 0, 1, 1 };
 	LOCAL f32 FLIP_HOR_UVS[8] = { 1, 1, 1, 0, 0, 0, 0, 1 };
@@ -310,7 +635,7 @@ void draw_texture_rotated(RenderBatch* batch, Texture tex, i32 x, i32 y, f32 rot
 
 INTERNAL inline
 void draw_texture_EX(RenderBatch* batch, Texture tex, Rect source, Rect dest, f32 r, f32 g, f32 b, f32 a) {
-	if (tex.ID == 0)
+	if (tex.ID == 0 || !batch_accepts_texture(batch, tex))
 		return;
 
 	r /= 255.0f;
@@ -360,7 +685,7 @@ void draw_texture_EX(RenderBatch* batch, Texture tex, Rect source, Rect dest, f3
 		uvs[7] = (source.y + source.height) / tex.height;
 	}
 
-	i32 texSlot = submit_tex(batch, tex);
+	i32 texSlot = reserve_sprite(batch, tex);
 
 	batch->buffer->pos = {dest.x, dest.y};
 	batch->buffer->color = { r, g, b, a };
@@ -420,7 +745,9 @@ void draw_text(RenderBatch* batch, Font* font, const char* str, i32 xPos, i32 yP
 		int y = yPos + yOffset;
 
 		Texture tex = font->characters[str[i]]->texture;
-		int texSlot = submit_tex(batch, tex);
+		if (!batch_accepts_texture(batch, tex))
+			continue;
+		int texSlot = reserve_sprite(batch, tex);
 		GLfloat* uvs;
 		uvs = DEFAULT_UVS;
 
@@ -488,6 +815,8 @@ void draw_rectangle(RenderBatch* batch, i32 xPos, i32 yPos, i32 width, i32 heigh
 	f32 x = (f32)xPos;
 	f32 y = (f32)yPos;
 
+	reserve_sprite(batch);
+
 	r /= 255;
 	g /= 255;
 	b /= 255;
@@ -531,35 +860,65 @@ void draw_rectangle(RenderBatch* batch, i32 x, i32 y, i32 width, i32 height, vec
 
 INTERNAL inline
 void end2D(RenderBatch* batch) {
+	PROFILE_SCOPE("end2D");
+	//with an explicit flush only the part of the region that was written gets sent
+	if (batch->streaming == BATCH_STREAM_RING && batch->spritecount > 0)
+		glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, batch->spritecount * BATCH_SPRITE_SIZE);
 	glUnmapBuffer(GL_ARRAY_BUFFER);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	for (u16 i = 0; i < batch->texcount; ++i) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, batch->textures[i]);
-		upload_int(batch->shader, batch->locations[i], i);
+	batch->stats.bytesUploaded += batch->spritecount * BATCH_SPRITE_SIZE;
+
+	//textures, the vao and the program are left bound afterwards; the state cache makes
+	//binding them again next flush free if nothing has changed.
+	if (batch->indexcount > 0) {
+		if (batch->texarray != 0)
+			gl_bind_texture(GL_TEXTURE_2D_ARRAY, batch->texarray, 0);
+		for (u16 i = 0; i < batch->texcount; ++i)
+			gl_bind_texture(GL_TEXTURE_2D, batch->textures[i], i);
+
+		gl_bind_vertex_array(batch->vaos[batch->region]);
+
+		GpuTimer* gpu = &batch->gpu;
+		bool timed = gpu->supported && gpu->used[gpu->frame] < GPU_TIMER_MAX_QUERIES;
+		if (timed)
+			glBeginQuery(BMT_TIME_ELAPSED, gpu->queries[gpu->frame][gpu->used[gpu->frame]++]);
+		glDrawElements(GL_TRIANGLES, batch->indexcount, GL_UNSIGNED_INT, (const GLvoid*)(batch->regionOffset * 6 * sizeof(GLuint)));
+		if (timed)
+			glEndQuery(BMT_TIME_ELAPSED);
+		batch->stats.drawCalls++;
+
+		//the next flush carries on in the same region, and only a full one gets a fence
+		if (batch->streaming == BATCH_STREAM_RING) {
+			batch->regionOffset += batch->spritecount;
+			if (batch->regionOffset >= BATCH_MAX_SPRITES) {
+				batch->fences[batch->region] = bmtFenceSync(BMT_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				batch->region = (batch->region + 1) % BATCH_RING_REGIONS;
+				batch->regionOffset = 0;
+			}
+		}
 	}
 
-	glBindVertexArray(batch->vao);
-	glEnableVertexAttribArray(0); //position
-	glEnableVertexAttribArray(1); //color
-	glEnableVertexAttribArray(2); //texture coordinates
-	glEnableVertexAttribArray(3); //texture ID
-
-	glDrawElements(GL_TRIANGLES, batch->indexcount, GL_UNSIGNED_SHORT, 0);
-
-	glDisableVertexAttribArray(0); //position
-	glDisableVertexAttribArray(1); //color
-	glDisableVertexAttribArray(2); //texture coordinates
-	glDisableVertexAttribArray(3); //textureID
-	glBindVertexArray(0);
-
-	for (u16 i = 0; i < batch->texcount; ++i)
-		unbind_texture(batch->textures[i]);
-
 	batch->indexcount = 0;
+	batch->spritecount = 0;
 	batch->texcount = 0;
+}
 
+//==========================================================================================
+//Description: Points the tex1..tex16 samplers at texture units 0..15
+//
+//Comments: Sampler uniforms are program state, so this only needs doing once per shader.
+//			load_default_shader_2D() already does it; call it on any other shader used
+//			with begin2D().
+//==========================================================================================
+INTERNAL inline
+void upload_batch_samplers(Shader shader) {
+	LOCAL const GLchar* SAMPLERS[BATCH_MAX_TEXTURES] = {
+		"tex1", "tex2", "tex3", "tex4", "tex5", "tex6", "tex7", "tex8",
+		"tex9", "tex10", "tex11", "tex12", "tex13", "tex14", "tex15", "tex16"
+	};
+
+	start_shader(shader);
+	for (i32 i = 0; i < BATCH_MAX_TEXTURES; ++i)
+		upload_int(shader, SAMPLERS[i], i);
 	stop_shader();
 }
 
@@ -637,12 +996,80 @@ void main() {
 }
 
 )FOO";
-	return load_shader_2D_from_strings(ORTHO_SHADER_VERT_SHADER, ORTHO_SHADER_FRAG_SHADER);
+	Shader shader = load_shader_2D_from_strings(ORTHO_SHADER_VERT_SHADER, ORTHO_SHADER_FRAG_SHADER);
+	upload_batch_samplers(shader);
+	return shader;
+}
+
+//==========================================================================================
+//Description: Shader for batches started with begin2D_array().
+//
+//Comments: The vertex texid is the layer + 1 (0 still means untextured), so the fragment
+//			shader does one lookup instead of choosing between 16 samplers.
+//==========================================================================================
+INTERNAL inline
+Shader load_array_shader_2D() {
+	LOCAL const GLchar* ARRAY_SHADER_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+
+in vec4 pass_color;
+in vec2 pass_uv;
+flat in int pass_layer;
+
+uniform sampler2DArray pages;
+void main() {
+	vec4 texColor = vec4(1.0);
+	if(pass_layer >= 0)
+		texColor = texture(pages, vec3(pass_uv, float(pass_layer)));
+	outColor = pass_color * texColor;
+}
+
+)FOO";
+
+	LOCAL const GLchar* ARRAY_SHADER_VERT_SHADER = R"FOO(
+#version 130
+in vec2 position;
+in vec4 color;
+in vec2 uv;
+in float texid;
+
+uniform mat4 projection = mat4(1.0);
+uniform mat4 view = mat4(1.0);
+
+out vec4 pass_color;
+out vec2 pass_uv;
+flat out int pass_layer;
+
+void main() {
+	pass_color = color;
+	pass_uv = uv;
+	pass_layer = int(texid) - 1;
+	
+	gl_Position = projection * view * vec4(position, 1.0, 1.0);
+}
+
+)FOO";
+	Shader shader = load_shader_2D_from_strings(ARRAY_SHADER_VERT_SHADER, ARRAY_SHADER_FRAG_SHADER);
+	start_shader(shader);
+	upload_int(shader, "pages", 0);
+	stop_shader();
+	return shader;
 }
 
 INTERNAL inline
 void dispose_batch(RenderBatch* batch) {
-	glDeleteVertexArrays(1, &batch->vao);
+	for (u32 i = 0; i < BATCH_RING_REGIONS; ++i) {
+		if (batch->vaos[i] != 0) {
+			gl_forget_vertex_array(batch->vaos[i]);
+			glDeleteVertexArrays(1, &batch->vaos[i]);
+		}
+		if (batch->fences[i] != NULL)
+			bmtDeleteSync(batch->fences[i]);
+	}
+	if (batch->gpu.supported)
+		glDeleteQueries(GPU_TIMER_FRAMES * GPU_TIMER_MAX_QUERIES, &batch->gpu.queries[0][0]);
+	gl_forget_array_buffer(batch->vbo);
 	glDeleteBuffers(1, &batch->vbo);
 	glDeleteBuffers(1, &batch->ebo);
 	dispose_shader(batch->shader);
@@ -30,18 +30,61 @@
 #define SHADER_H
 
 #include "defines.h"
+#include "glstate.h"
 #include "maths.h"
 #include <vector>
 
+#define SHADER_MAX_UNIFORMS		32
+#define SHADER_MAX_UNIFORM_NAME	32
+
+//==========================================================================================
+//Description: Uniform locations looked up so far, so each name only goes to the driver once
+//
+//Comments: A Shader is passed around by value, so the cache is held by pointer and every
+//			copy of a Shader shares it.
+//==========================================================================================
+struct UniformCache {
+	u32 count;
+	u32 hashes[SHADER_MAX_UNIFORMS];
+	GLchar names[SHADER_MAX_UNIFORMS][SHADER_MAX_UNIFORM_NAME];
+	GLint locations[SHADER_MAX_UNIFORMS];
+};
+
 struct Shader {
 	GLuint ID;
 	GLuint vertexshaderID;
 	GLuint fragshaderID;
+	UniformCache* uniforms;
 };
 
+INTERNAL inline
+u32 hash_uniform_name(const GLchar* name) {
+	u32 hash = 2166136261u;
+	for (const GLchar* c = name; *c != '\0'; ++c)
+		hash = (hash ^ (u8)*c) * 16777619u;
+	return hash;
+}
+
 INTERNAL inline
 GLint get_uniform_location(Shader shader, const GLchar* name) {
-	return glGetUniformLocation(shader.ID, name);
+	UniformCache* cache = shader.uniforms;
+	if (cache == NULL)
+		return glGetUniformLocation(shader.ID, name);
+
+	u32 hash = hash_uniform_name(name);
+	for (u32 i = 0; i < cache->count; ++i) {
+		if (cache->hashes[i] == hash && strcmp(cache->names[i], name) == 0)
+			return cache->locations[i];
+	}
+
+	GLint location = glGetUniformLocation(shader.ID, name);
+	if (cache->count < SHADER_MAX_UNIFORMS && strlen(name) < SHADER_MAX_UNIFORM_NAME) {
+		cache->hashes[cache->count] = hash;
+		strcpy(cache->names[cache->count], name);
+		cache->locations[cache->count] = location;
+		cache->count++;
+	}
+	return location;
 }
 
 INTERNAL inline
@@ -116,8 +159,9 @@ Shader load_shader_2D(const GLchar* vertexfile, const GLchar* fragmentfile) {
 	glBindAttribLocation(shader.ID, 3, "texid");
 	glLinkProgram(shader.ID);
 	glValidateProgram(shader.ID);
+	shader.uniforms = (UniformCache*)calloc(1, sizeof(UniformCache));
 
-	glUseProgram(0);
+	gl_use_program(0);
 	return shader;
 }
 
@@ -136,8 +180,9 @@ Shader load_shader_3D(const GLchar* vertexfile, const GLchar* fragmentfile) {
 	glBindAttribLocation(shader.ID, 2, "normal");
 	glLinkProgram(shader.ID);
 	glValidateProgram(shader.ID);
+	shader.uniforms = (UniformCache*)calloc(1, sizeof(UniformCache));
 
-	glUseProgram(0);
+	gl_use_program(0);
 	return shader;
 }
 
@@ -157,8 +202,9 @@ Shader load_shader_2D_from_strings(const GLchar* vertexstring, const GLchar* fra
 	glBindAttribLocation(shader.ID, 3, "texid");
 	glLinkProgram(shader.ID);
 	glValidateProgram(shader.ID);
+	shader.uniforms = (UniformCache*)calloc(1, sizeof(UniformCache));
 
-	glUseProgram(0);
+	gl_use_program(0);
 	return shader;
 }
 
@@ -177,8 +223,9 @@ Shader load_shader_3D_from_strings(const GLchar* vertexstring, const GLchar* fra
 	glBindAttribLocation(shader.ID, 2, "normal");
 	glLinkProgram(shader.ID);
 	glValidateProgram(shader.ID);
+	shader.uniforms = (UniformCache*)calloc(1, sizeof(UniformCache));
 
-	glUseProgram(0);
+	gl_use_program(0);
 	return shader;
 }
 
@@ -244,19 +291,21 @@ void upload_mat4(Shader shader, const GLchar* name, mat4 mat) {
 
 INTERNAL inline
 void start_shader(Shader shader) {
-	glUseProgram(shader.ID);
+	gl_use_program(shader.ID);
 }
 
 INTERNAL inline
 void stop_shader() {
-	glUseProgram(0);
+	gl_use_program(0);
 }
 
 INTERNAL inline
 void dispose_shader(Shader shader) {
 	glDeleteShader(shader.fragshaderID);
 	glDeleteShader(shader.vertexshaderID);
+	gl_forget_program(shader.ID);
 	glDeleteProgram(shader.ID);
+	free(shader.uniforms);
 }
 
 #endif
\ No newline at end of file
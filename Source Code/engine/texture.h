@@ -30,6 +30,8 @@
 #define TEXTURE_H
 
 #include "defines.h"
+#include "glstate.h"
+#include "trace.h"
 #include <vector>
 #include <SOIL.h>
 
@@ -41,22 +43,26 @@ struct Texture {
 	u64 flip_flag;
 	i32 width;
 	i32 height;
+	u32 layer; //only used when the texture is a layer of a TextureArray
+	GLuint array; //the TextureArray this is a layer of, or 0 for a plain 2D texture
 };
 
 INTERNAL inline
 Texture create_blank_texture(u32 width = 0, u32 height = 0) {
 	Texture texture;
 	glGenTextures(1, &texture.ID);
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 	texture.width = width;
 	texture.height = height;
 	texture.flip_flag = 0;
+	texture.layer = 0;
+	texture.array = 0;
 
 	return texture;
 }
@@ -68,29 +74,33 @@ Texture load_texture(unsigned char* pixels, u32 width, u32 height, u16 param) {
 	texture.height = height;
 
 	glGenTextures(1, &texture.ID);
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 	texture.flip_flag = 0;
+	texture.layer = 0;
+	texture.array = 0;
 
 	return texture;
 }
 
 INTERNAL inline
 void dispose_texture(Texture& texture) {
+	gl_forget_texture(texture.ID);
 	glDeleteTextures(1, &texture.ID);
 	texture.ID = 0;
 }
 
 INTERNAL inline
 Texture load_texture(const char* filepath, u16 param) {
+	TRACE_SCOPE(trace_intern(filepath));
 	Texture texture;
 	glGenTextures(1, &texture.ID);
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID);
 	unsigned char* image = SOIL_load_image(filepath, &texture.width, &texture.height, 0, SOIL_LOAD_RGBA);
 	if (image != NULL) {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
@@ -104,38 +114,38 @@ Texture load_texture(const char* filepath, u16 param) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 	texture.flip_flag = 0;
+	texture.layer = 0;
+	texture.array = 0;
 
 	return texture;
 }
 
 INTERNAL inline
 void set_texture_pixels(Texture texture, unsigned char* pixels, u32 width, u32 height) {
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 }
 
 INTERNAL inline
 void set_texture_pixels_from_file(Texture texture, const char* filepath) {
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID);
 	unsigned char* image = SOIL_load_image(filepath, &texture.width, &texture.height, 0, SOIL_LOAD_RGBA);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 }
 
 INTERNAL inline
 void bind_texture(Texture texture, u32 slot) {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, texture.ID, slot);
 }
 
 INTERNAL inline
 void unbind_texture(u32 slot) {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0, slot);
 }
 
 //==========================================================================================
@@ -170,6 +180,95 @@ void set_texture_wrap_y(Texture texture, u32 type) {
 	unbind_texture(0);
 }
 
+//==========================================================================================
+//Description: A GL_TEXTURE_2D_ARRAY where every layer is the same size. Each layer is
+//			   handed out as a Texture (see add_texture_array_layer) that can be drawn with
+//			   a batch started by begin2D_array().
+//==========================================================================================
+struct TextureArray {
+	GLuint ID;
+	i32 width;
+	i32 height;
+	u32 layers;
+	u32 count;
+};
+
+INTERNAL inline
+TextureArray create_texture_array(u32 width, u32 height, u32 layers, u16 param) {
+	TextureArray arr = { 0 };
+	arr.width = width;
+	arr.height = height;
+	arr.layers = layers;
+
+	glGenTextures(1, &arr.ID);
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, arr.ID);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, param);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, param);
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return arr;
+}
+
+//==========================================================================================
+//Description: Uploads pixels into the next free layer of the array
+//
+//Parameters: 
+//		-The array to add to
+//		-RGBA pixels, which must be exactly the size of the array's layers
+//
+//Comments: Returns a Texture whose ID is the array and whose layer is the new layer.
+//			Returns a blank texture if the array is full or the size does not match.
+//==========================================================================================
+INTERNAL inline
+Texture add_texture_array_layer(TextureArray* arr, unsigned char* pixels, u32 width, u32 height) {
+	Texture texture = { 0 };
+	if (arr->count >= arr->layers) {
+		BMT_LOG(WARNING, "Texture array #%d is full (%d layers)", arr->ID, arr->layers);
+		return texture;
+	}
+	if (width != (u32)arr->width || height != (u32)arr->height) {
+		BMT_LOG(WARNING, "Texture array #%d layers are %dx%d, got %dx%d", arr->ID, arr->width, arr->height, width, height);
+		return texture;
+	}
+
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, arr->ID);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, arr->count, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, 0);
+
+	texture.ID = arr->ID;
+	texture.width = width;
+	texture.height = height;
+	texture.flip_flag = 0;
+	texture.layer = arr->count++;
+	texture.array = arr->ID;
+	return texture;
+}
+
+INTERNAL inline
+Texture add_texture_array_layer(TextureArray* arr, const char* filepath) {
+	Texture texture = { 0 };
+	i32 width;
+	i32 height;
+	unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image != NULL)
+		texture = add_texture_array_layer(arr, image, width, height);
+	else
+		BMT_LOG(WARNING, "[%s] Texture could not be loaded! Returning blank texture.", filepath);
+	SOIL_free_image_data(image);
+	return texture;
+}
+
+INTERNAL inline
+void dispose_texture_array(TextureArray& arr) {
+	gl_forget_texture(arr.ID);
+	glDeleteTextures(1, &arr.ID);
+	arr.ID = 0;
+	arr.count = 0;
+}
+
 struct Framebuffer {
 	GLuint ID;
 	Texture texture;
@@ -186,9 +285,11 @@ Framebuffer create_framebuffer(u32 width, u32 height, u16 param, u8 buffertype)
 	buffer.texture.width = width;
 	buffer.texture.height = height;
 	buffer.texture.flip_flag = 0;
+	buffer.texture.layer = 0;
+	buffer.texture.array = 0;
 
 	glGenTextures(1, &buffer.texture.ID);
-	glBindTexture(GL_TEXTURE_2D, buffer.texture.ID);
+	gl_bind_texture(GL_TEXTURE_2D, buffer.texture.ID);
 	if (buffertype == COLORBUFFER) {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -201,7 +302,7 @@ Framebuffer create_framebuffer(u32 width, u32 height, u16 param, u8 buffertype)
 	}
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 
 	glGenFramebuffers(1, &buffer.ID);
 	glBindFramebuffer(GL_FRAMEBUFFER, buffer.ID);
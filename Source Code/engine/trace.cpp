@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       trace.cpp                                 //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "trace.h"
+
+struct TraceEvent {
+	const char* name;
+	u64 start;
+	u64 end;
+};
+
+struct TraceRing {
+	u32 tid;
+	const char* threadName;
+	std::atomic<u64> head; //total events ever written; the newest is at (head - 1) % TRACE_RING_SIZE
+	TraceEvent events[TRACE_RING_SIZE];
+};
+
+GLOBAL std::mutex registryMutex;
+GLOBAL std::vector<TraceRing*> rings;
+GLOBAL std::unordered_set<std::string> internedNames;
+GLOBAL std::atomic<bool> traceEnabled(true);
+GLOBAL const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+GLOBAL thread_local TraceRing* threadRing;
+
+INTERNAL inline
+TraceRing* get_thread_ring() {
+	if (threadRing == NULL) {
+		TraceRing* ring = new TraceRing();
+		ring->head.store(0, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		ring->tid = rings.size() + 1;
+		ring->threadName = NULL;
+		rings.push_back(ring);
+		threadRing = ring;
+	}
+	return threadRing;
+}
+
+u64 trace_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void trace_record(const char* name, u64 startNs, u64 endNs) {
+	if (!traceEnabled.load(std::memory_order_relaxed))
+		return;
+
+	TraceRing* ring = get_thread_ring();
+	u64 head = ring->head.load(std::memory_order_relaxed);
+	TraceEvent* event = &ring->events[head % TRACE_RING_SIZE];
+	event->name = name;
+	event->start = startNs;
+	event->end = endNs;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void set_trace_enabled(bool enabled) {
+	traceEnabled.store(enabled);
+}
+
+bool is_trace_enabled() {
+	return traceEnabled.load();
+}
+
+void set_trace_thread_name(const char* name) {
+	get_thread_ring()->threadName = trace_intern(name);
+}
+
+const char* trace_intern(const char* name) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	return internedNames.insert(name).first->c_str();
+}
+
+INTERNAL inline
+void write_json_string(FILE* file, const char* str) {
+	fputc('"', file);
+	for (const char* c = str; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\')
+			fputc('\\', file);
+		if ((u8)*c < 0x20)
+			fprintf(file, "\\u%04x", *c);
+		else
+			fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+//==========================================================================================
+//Description: Writes every recorded event to a Chrome trace-event JSON file.
+//
+//Comments: Meant to be called from the main thread between frames. Events being written
+//			by another thread while dumping may be missed, or show up as the scope that
+//			was overwritten.
+//==========================================================================================
+bool dump_trace(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Could not open file to write the trace", filename);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+	u64 total = 0;
+	for (u32 r = 0; r < rings.size(); ++r) {
+		TraceRing* ring = rings[r];
+		if (ring->threadName != NULL) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", ring->tid);
+			write_json_string(file, ring->threadName);
+			fprintf(file, "}}");
+			first = false;
+		}
+
+		u64 head = ring->head.load(std::memory_order_acquire);
+		u64 begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for (u64 i = begin; i < head; ++i) {
+			TraceEvent* event = &ring->events[i % TRACE_RING_SIZE];
+			fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+			write_json_string(file, event->name);
+			//timestamps are in microseconds
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				ring->tid, event->start / 1000.0, (event->end - event->start) / 1000.0);
+			first = false;
+		}
+		total += head - begin;
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	BMT_LOG(INFO, "[%s] Trace written (%d events)", filename, (u32)total);
+	return true;
+}
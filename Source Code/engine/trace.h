@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       trace.h                                   //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2019 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "defines.h"
+
+#define TRACE_RING_SIZE		65536 //events kept per thread; the oldest are overwritten
+
+//==========================================================================================
+//Description: Records timed scopes into a ring per thread, which can be written out as
+//			   Chrome trace-event JSON and opened in Perfetto or chrome://tracing.
+//
+//Comments: Each thread writes only to its own ring, so recording takes no locks. A lock
+//			is only taken the first time a thread records, to register its ring, and
+//			when dumping. Scope names must outlive the dump; use trace_intern() for names
+//			that are built at runtime.
+//==========================================================================================
+void trace_record(const char* name, u64 startNs, u64 endNs);
+u64 trace_now();
+void set_trace_enabled(bool enabled);
+bool is_trace_enabled();
+void set_trace_thread_name(const char* name);
+const char* trace_intern(const char* name);
+bool dump_trace(const char* filename);
+
+struct TraceScope {
+	const char* name;
+	u64 start;
+	TraceScope(const char* name) : name(name), start(trace_now()) {}
+	~TraceScope() { trace_record(name, start, trace_now()); }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if defined(BMT_NO_TRACE)
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif
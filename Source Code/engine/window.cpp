@@ -26,8 +26,9 @@
 // SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
 ///////////////////////////////////////////////////////////////////////////
 
-#include <thread>
 #include "window.h"
+#include "profiler.h"
+#include "trace.h"
 
 GLOBAL GLFWwindow* glfw_window;
 GLOBAL i32 winVirtualWidth;
@@ -233,14 +234,17 @@ void set_clear_color(vec4 color) {
 }
 
 void begin_drawing() {
+	TRACE_SCOPE("begin_drawing");
 	currentTime = glfwGetTime();
 	updateTime = currentTime - previousTime;
 	previousTime = currentTime;
 
+	profile_begin_frame();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void end_drawing() {
+	TRACE_SCOPE("end_drawing");
 	for (int i = 0; i < MAX_KEYS; ++i) {
 		keys[i] = -1;
 	}
@@ -254,8 +258,11 @@ void end_drawing() {
 	lastScrollX = 0;
 	lastScrollY = 0;
 
+	profile_begin("swap buffers");
 	glfwSwapBuffers(glfw_window);
+	profile_end();
 	glfwPollEvents();
+	profile_end_frame();
 
 	currentTime = glfwGetTime();
 	drawTime = currentTime - previousTime;
@@ -0,0 +1,207 @@
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include "map.h"
+
+//The levels on the choose map screen come from a manifest, data/levels.txt, which is read
+//once at startup into a LevelTable. The table is flat arrays that each Level indexes into,
+//so starting a level copies its walls, turrets, gold piles and waves out of the table with
+//no text to parse. A level is referred to by its index, which is what replays record to
+//know which map they start on.
+//
+//manifest layout: a "level <name>" line starts each level, followed by the scenario
+//directives (see load_scenario) and "wall x y" for starting walls. Turrets take an
+//optional shot delay after their type. # lines are comments.
+
+#define LEVEL_MANIFEST	"data/levels.txt"
+
+struct LevelGroup {
+	u8 type;
+	u8 side;
+};
+
+struct LevelWave {
+	u32 firstGroup;
+	u32 numGroups;
+};
+
+struct LevelWall {
+	i16 x;
+	i16 y;
+};
+
+struct Level {
+	char name[64];
+	char map[128];
+	u32 money;
+	u32 nextWaveTime;
+	u32 firstWall;
+	u32 numWalls;
+	u32 firstTurret;
+	u32 numTurrets;
+	u32 firstGoldpile;
+	u32 numGoldpiles;
+	u32 firstWave;
+	u32 numWaves;
+};
+
+struct LevelTable {
+	std::vector<Level> levels;
+	std::vector<LevelWall> walls;
+	std::vector<Turret> turrets;
+	std::vector<GoldPile> goldpiles;
+	std::vector<LevelWave> waves;
+	std::vector<LevelGroup> groups;
+};
+
+static inline
+bool parse_side(const char* token, Side* side) {
+	switch (token[0]) {
+	case 'n': *side = SIDE_NORTH; return true;
+	case 's': *side = SIDE_SOUTH; return true;
+	case 'e': *side = SIDE_EAST; return true;
+	case 'w': *side = SIDE_WEST; return true;
+	}
+	return false;
+}
+
+static inline
+LevelTable load_level_table(const char* filename) {
+	TRACE_SCOPE("load_level_table");
+	LevelTable table;
+
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
+
+	char line[1024];
+	u32 lineNumber = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		char directive[32];
+		i32 length = 0;
+		if (sscanf(line, "%31s%n", directive, &length) != 1 || directive[0] == '#')
+			continue;
+		const char* args = line + length;
+
+		if (strcmp(directive, "level") == 0) {
+			Level level = { 0 };
+			while (*args == ' ' || *args == '\t')
+				args++;
+			strncpy(level.name, args, sizeof(level.name) - 1);
+			level.name[strcspn(level.name, "\r\n")] = '\0';
+			level.firstWall = table.walls.size();
+			level.firstTurret = table.turrets.size();
+			level.firstGoldpile = table.goldpiles.size();
+			level.firstWave = table.waves.size();
+			table.levels.push_back(level);
+			continue;
+		}
+		if (table.levels.size() == 0)
+			BMT_LOG(FATAL_ERROR, "[%s:%d] '%s' comes before the first level", filename, lineNumber, directive);
+		Level* level = &table.levels.back();
+
+		bool parsed = true;
+		if (strcmp(directive, "map") == 0) {
+			parsed = sscanf(args, "%127s", level->map) == 1;
+		}
+		else if (strcmp(directive, "money") == 0) {
+			parsed = sscanf(args, "%u", &level->money) == 1;
+		}
+		else if (strcmp(directive, "time") == 0) {
+			parsed = sscanf(args, "%u", &level->nextWaveTime) == 1;
+		}
+		else if (strcmp(directive, "wall") == 0) {
+			i32 x, y;
+			parsed = sscanf(args, "%d %d", &x, &y) == 2;
+			table.walls.push_back({ (i16)x, (i16)y });
+			level->numWalls++;
+		}
+		else if (strcmp(directive, "gold") == 0) {
+			i32 x, y, coins;
+			parsed = sscanf(args, "%d %d %d", &x, &y, &coins) == 3;
+			table.goldpiles.push_back({ (i16)x, (i16)y, (u8)coins });
+			level->numGoldpiles++;
+		}
+		else if (strcmp(directive, "turret") == 0) {
+			i32 x, y, type, shotDelay = -1;
+			parsed = sscanf(args, "%d %d %d %d", &x, &y, &type, &shotDelay) >= 3;
+			Turret turret = { 0 };
+			turret.x = x;
+			turret.y = y;
+			turret.type = (TurretType)type;
+			if (shotDelay < 0)
+				shotDelay = turret.type == TURRET_CANNON ? 140 : turret.type == TURRET_MAGE ? 300 : 105;
+			turret.shotDelay = shotDelay;
+			table.turrets.push_back(turret);
+			level->numTurrets++;
+		}
+		else if (strcmp(directive, "wave") == 0) {
+			LevelWave wave = { (u32)table.groups.size(), 0 };
+			u32 count = 0;
+			parsed = sscanf(args, "%u%n", &count, &length) == 1;
+			args += length;
+			for (u32 i = 0; i < count && parsed; ++i) {
+				i32 type;
+				char sideToken[8];
+				Side side;
+				parsed = sscanf(args, "%d %7s%n", &type, sideToken, &length) == 2 && parse_side(sideToken, &side);
+				args += length;
+				table.groups.push_back({ (u8)type, (u8)side });
+				wave.numGroups++;
+			}
+			table.waves.push_back(wave);
+			level->numWaves++;
+		}
+		else {
+			BMT_LOG(WARNING, "[%s:%d] Unknown directive '%s'", filename, lineNumber, directive);
+		}
+
+		if (!parsed)
+			BMT_LOG(FATAL_ERROR, "[%s:%d] Could not read '%s'", filename, lineNumber, directive);
+	}
+	fclose(file);
+
+	for (u32 i = 0; i < table.levels.size(); ++i) {
+		if (table.levels[i].map[0] == '\0')
+			BMT_LOG(FATAL_ERROR, "[%s] Level '%s' has no map", filename, table.levels[i].name);
+	}
+	return table;
+}
+
+static inline
+Game load_level(LevelTable* table, u32 index) {
+	Game game = { GAME_MENU };
+	if (index >= table->levels.size()) {
+		BMT_LOG(WARNING, "There is no level %d", index);
+		game.map = create_map(1, 1);
+		return game;
+	}
+	Level* level = &table->levels[index];
+
+	game.map = load_map(level->map);
+	for (u32 i = 0; i < level->numWalls; ++i) {
+		LevelWall* wall = &table->walls[level->firstWall + i];
+		if (wall->x >= 0 && wall->y >= 0 && (u32)wall->x < game.map.width && (u32)wall->y < game.map.height)
+			game.map.walls[wall->x + wall->y * game.map.width] = { true, false, WALL_HP, 6 };
+	}
+	game.map.turrets.assign(table->turrets.begin() + level->firstTurret, table->turrets.begin() + level->firstTurret + level->numTurrets);
+	game.map.goldpiles.assign(table->goldpiles.begin() + level->firstGoldpile, table->goldpiles.begin() + level->firstGoldpile + level->numGoldpiles);
+
+	game.waves.resize(level->numWaves);
+	for (u32 i = 0; i < level->numWaves; ++i) {
+		LevelWave* wave = &table->waves[level->firstWave + i];
+		game.waves[i].reserve(wave->numGroups);
+		for (u32 j = 0; j < wave->numGroups; ++j) {
+			LevelGroup* group = &table->groups[wave->firstGroup + j];
+			game.waves[i].push_back(create_group((UnitType)group->type, (Side)group->side));
+		}
+	}
+
+	game.currentWave = 0;
+	game.nextWaveTime = level->nextWaveTime;
+	game.money = level->money;
+	return game;
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "bahamut.h"
 #include "map.h"
+#include "snapshot.h"
+#include "replay.h"
 
 #ifdef _DEBUG
 #else
@@ -7,7 +9,7 @@
 #endif
 
 static inline 
-void choose_map(RenderBatch* batch, Game* selectedMap, Game* demo, MainState* state, MapScene* scene, BitmapFont* font, vec2 mouse) {
+void choose_map(RenderBatch* batch, Game* selectedMap, Game* demo, MainState* state, MapScene* scene, BitmapFont* font, vec2 mouse, LevelTable* levels, Replay* recording, SnapshotRing* ring) {
 	i32 yInitial = (get_window_height() / 2) - (((16 * 3) + 15) * 3) + 50;
 
 	game(batch, demo, scene, mouse, state, true);
@@ -15,121 +17,14 @@ void choose_map(RenderBatch* batch, Game* selectedMap, Game* demo, MainState* st
 	draw_text(batch, font, "  Defend Your Bounty!", (get_window_width() / 2) - (get_string_width(font, "  Defend Your Bounty!") / 2), 50);
 	draw_text(batch, font, "  Choose Map", (get_window_width() / 2) - (get_string_width(font, "  Choose Map") / 2), yInitial-50);
 
-	if (text_button(batch, font, "  Crankshockz Bay (EASY)", &yInitial, mouse)) {
-		*selectedMap = { GAME_MENU };
-		selectedMap->map = load_map("data/crankshockz.txt");
-		selectedMap->map.walls[5 + 6 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 5, 6, 0, 0, 150, TURRET_CANNON });
-		add_wave(selectedMap, format_text("%d n", UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d s %d s %d e %d s %d e %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP));
-		add_wave(selectedMap, format_text("%d s %d e %d e %d s %d e", UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP));
-		add_wave(selectedMap, format_text("%d s %d s %d e %d e %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d s %d s %d s %d e %d e %d e", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_RUSH_SHIP, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d e %d s %d e %d e", UNIT_GOLIATH_SHIP, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d e %d s %d s %d e", UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d s %d e %d s %d e %d e %d e", UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d e %d e %d s %d e", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_RUSH_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d e %d s %d e %d s %d e", UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_MAGE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d e %d s %d e %d e", UNIT_RUSH_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_RUSH_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d s %d e %d s %d e %d s %d e %d s", UNIT_GOLIATH_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_STONETHROWER_SHIP));
-		selectedMap->currentWave = 0;
-		selectedMap->nextWaveTime = 3200;
-		selectedMap->money = 3000;
-		selectedMap->map.goldpiles.push_back({5, 4, 10});
-		*state = MAIN_GAME;
-	}
-
-	if (text_button(batch, font, "  Pegleg John's Bluff (NORMAL)", &yInitial, mouse)) {
-		*selectedMap = { GAME_MENU };
-		selectedMap->map = load_map("data/PeglegJohnBluff.txt");
-		selectedMap->map.walls[15 + 7 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 15, 7, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[15 + 19 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 15, 19, 0, 0, 150, TURRET_CANNON });
-		add_wave(selectedMap, format_text("%d n", UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d n %d n %d s %d e %d e %d e", UNIT_ELITE_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d n %d n", UNIT_MAGE_SHIP, UNIT_RUSH_SHIP, UNIT_DINGHY, UNIT_STONETHROWER_SHIP));
-		add_wave(selectedMap, format_text("%d e %d e %d s %d s %d n %d n", UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d n", UNIT_MAGE_SHIP, UNIT_ELITE_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d e %d e %d s %d e", UNIT_EDRIC_SHIP, UNIT_RUSH_SHIP, UNIT_MAGE_SHIP, UNIT_RUSH_SHIP, UNIT_MAGE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d n %d e", UNIT_GOLIATH_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP));
-		selectedMap->currentWave = 0;
-		selectedMap->nextWaveTime = 2800;
-		selectedMap->money = 2500;
-		selectedMap->map.goldpiles.push_back({ 15, 8, 10 });
-		selectedMap->map.goldpiles.push_back({ 15, 18, 10 });
-		*state = MAIN_GAME;
-	}
-
-	if (text_button(batch, font, "  Bluebeard's Torment (HARD)", &yInitial, mouse)) {
-		*selectedMap = { GAME_MENU };
-		selectedMap->map = load_map("data/BluebeardsTorment.txt");
-		selectedMap->map.walls[25 + 19 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 25, 19, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[20 + 9 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 20, 9, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[14 + 19 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.turrets.push_back({ 14, 19, 0, 0, 150, TURRET_CANNON });
-		add_wave(selectedMap, format_text("%d n", UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d n %d n %d s %d e %d e %d e", UNIT_ELITE_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d n %d n", UNIT_MAGE_SHIP, UNIT_RUSH_SHIP, UNIT_DINGHY, UNIT_STONETHROWER_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d n %d n", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d e %d s %d s %d n %d n", UNIT_DINGHY, UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d n", UNIT_MAGE_SHIP, UNIT_ELITE_SHIP, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d e %d e %d s %d e", UNIT_EDRIC_SHIP, UNIT_RUSH_SHIP, UNIT_MAGE_SHIP, UNIT_RUSH_SHIP, UNIT_MAGE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d n %d n", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_DINGHY, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d e", UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_MAGE_SHIP, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d e %d s %d s %d n %d n %d e", UNIT_GOLIATH_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_STONETHROWER_SHIP, UNIT_ELITE_SHIP));
-		selectedMap->currentWave = 0;
-		selectedMap->nextWaveTime = 2650;
-		selectedMap->money = 2500;
-		selectedMap->map.goldpiles.push_back({ 25, 18, 10 });
-		selectedMap->map.goldpiles.push_back({ 20, 10, 10 });
-		selectedMap->map.goldpiles.push_back({ 14, 18, 10 });
-		*state = MAIN_GAME;
-	}
-
-	if (text_button(batch, font, "  I am NOT enjoying my life (IMPOSSIBLE)", &yInitial, mouse)) {
-		*selectedMap = { GAME_MENU };
-		selectedMap->map = load_map("data/impossible.txt");
-
-		selectedMap->map.turrets.push_back({ 35, 29, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[35 + 29 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.goldpiles.push_back({ 35, 28, 10 });
-
-		selectedMap->map.turrets.push_back({ 15, 13, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[15 + 13 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.goldpiles.push_back({15, 14, 10 });
-
-		selectedMap->map.turrets.push_back({ 15, 26, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[15 + 26 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.goldpiles.push_back({ 15, 25, 10 });
-
-		selectedMap->map.turrets.push_back({ 35, 12, 0, 0, 150, TURRET_CANNON });
-		selectedMap->map.walls[35 + 12 * selectedMap->map.width] = { true, false, 80, 6 };
-		selectedMap->map.goldpiles.push_back({ 35, 13, 10 });
-
-		add_wave(selectedMap, format_text("%d n", UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d e", UNIT_MAGE_SHIP, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d n", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d e %d s %d w", UNIT_RUSH_SHIP, UNIT_DINGHY, UNIT_RUSH_SHIP, UNIT_RUSH_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d n %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_ELITE_SHIP, UNIT_DINGHY, UNIT_ELITE_SHIP));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d s", UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		add_wave(selectedMap, format_text("%d n %d s %d e %d w %d s", UNIT_GOLIATH_SHIP, UNIT_STONETHROWER_SHIP, UNIT_DINGHY, UNIT_DINGHY, UNIT_DINGHY));
-		selectedMap->currentWave = 0;
-		selectedMap->nextWaveTime = 2950;
-		selectedMap->money = 2600;
-		*state = MAIN_GAME;
+	for (u32 i = 0; i < levels->levels.size(); ++i) {
+		if (text_button(batch, font, format_text("  %s", levels->levels[i].name), &yInitial, mouse)) {
+			dispose_map(&selectedMap->map);
+			start_recording(recording, i, NULL);
+			clear_snapshot_ring(ring);
+			*selectedMap = load_level(levels, i);
+			*state = MAIN_GAME;
+		}
 	}
 
 	if (text_button(batch, font, "  Back", &yInitial, mouse)) {
@@ -341,7 +236,34 @@ Game initialize_demo_map() {
 	return g;
 }
 
-int main() {
+static inline
+void reset_demo_map(Game* demo) {
+	dispose_map(&demo->map);
+	*demo = initialize_demo_map();
+}
+
+int main(int argc, char** argv) {
+	//--trace writes trace.json on exit, F11 writes it at any time
+	//--scenario starts straight into a scenario file, such as one written by map_gen
+	//--snapshot resumes a quicksave or the autosave left by a crash
+	//--replay plays back a recording, every game is recorded to data/last.replay
+	bool traceOnExit = false;
+	const char* scenariofile = NULL;
+	const char* snapshotfile = NULL;
+	const char* replayfile = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--trace") == 0)
+			traceOnExit = true;
+		else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc)
+			scenariofile = argv[++i];
+		else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+			snapshotfile = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayfile = argv[++i];
+	}
+	set_trace_thread_name("main");
+	init_jobs();
+
 	Config config = load_config();
 	init_window(1400, 800, "Defend Your Bounty", config.fullscreen, true, true);
 	init_audio();
@@ -351,10 +273,11 @@ int main() {
 	set_master_volume(config.volume);
 	set_vsync(config.vsync);
 
-	RenderBatch* batch = &create_batch();
+	RenderBatch* batch = &create_batch(BATCH_STREAM_RING);
 	MainState state = MAIN_TITLE;
 
 	MapScene scene = load_scene();
+	LevelTable levels = load_level_table(LEVEL_MANIFEST);
 
 	Editor edit = { 0 };
 	edit.selectedTile = 72;
@@ -369,7 +292,27 @@ int main() {
 	f32 creditsScroll = 0;
 
 	Game demo = initialize_demo_map();
-	Game g;
+	Game g = { GAME_IDLE };
+	Replay replay = { 0 };
+	SnapshotRing ring = {};
+	if (scenariofile != NULL) {
+		start_recording(&replay, -1, scenariofile);
+		clear_snapshot_ring(&ring);
+		g = load_scenario(scenariofile);
+		state = MAIN_GAME;
+	}
+	if (snapshotfile != NULL && load_snapshot(&g, &scene, snapshotfile)) {
+		replay.recording = false;
+		clear_snapshot_ring(&ring);
+		state = MAIN_GAME;
+	}
+	if (replayfile != NULL && load_replay(&replay, replayfile)) {
+		dispose_map(&g.map);
+		clear_snapshot_ring(&ring);
+		g = start_replay(&replay, &levels);
+		state = MAIN_GAME;
+	}
+	u32 autosavedWave = g.currentWave;
 
 	Sound blackmoorTides = load_sound("data/sounds/Blackmoor Tides Loop.wav");
 	set_sound_looping(blackmoorTides, true);
@@ -379,31 +322,33 @@ int main() {
 	f32 camrot = 0;
 	demo.map.x = -150;
 	demo.map.y = -210;
+	bool showProfiler = false;
 
 	while (window_open()) {
 		set_viewport(0, 0, get_window_width(), get_window_height());
 		vec2 mouse = get_mouse_pos();
 
 		begin_drawing();
+		reset_render_stats(batch);
 		begin2D(batch, basic);
 		upload_mat4(basic, "projection", orthographic_projection(0, 0, get_window_width(), get_window_height(), -1, 1));
 
 		if (state == MAIN_EDITOR)
 			editor(batch, &edit, &scene, mouse);
 		if (state == MAIN_GAME)
-			game(batch, &g, &scene, mouse, &state);
+			game(batch, &g, &scene, mouse, &state, false, &replay);
 		if (state == MAIN_TITLE) {
 			title_screen(batch, &demo, &state, &scene, &big, mouse, &creditsScroll);
 			if (demo.map.turrets.size() == 0)
-				demo = initialize_demo_map();
+				reset_demo_map(&demo);
 			camrot += 0.005f;
 			demo.map.x += cos(camrot) * .5;
 			demo.map.y += sin(camrot) * .5;
 		}
 		if (state == MAIN_CHOOSE_MAP) {
-			choose_map(batch, &g, &demo, &state, &scene, &big, mouse);
+			choose_map(batch, &g, &demo, &state, &scene, &big, mouse, &levels, &replay, &ring);
 			if (goldpile_depleted(&demo.map))
-				demo = initialize_demo_map();
+				reset_demo_map(&demo);
 			camrot += 0.005f;
 			demo.map.x += cos(camrot) * .5;
 			demo.map.y += sin(camrot) * .5;
@@ -411,7 +356,7 @@ int main() {
 		if (state == MAIN_OPTIONS) {
 			options(batch, &state, &big, &demo, &config, &scene, mouse);
 			if (goldpile_depleted(&demo.map))
-				demo = initialize_demo_map();
+				reset_demo_map(&demo);
 			camrot += 0.005f;
 			demo.map.x += cos(camrot) * .5;
 			demo.map.y += sin(camrot) * .5;
@@ -426,7 +371,7 @@ int main() {
 			game(batch, &demo, &scene, mouse, &state, true);
 
 			if (goldpile_depleted(&demo.map))
-				demo = initialize_demo_map();
+				reset_demo_map(&demo);
 			camrot += 0.005f;
 			demo.map.x += cos(camrot) * .5;
 			demo.map.y += sin(camrot) * .5;
@@ -464,8 +409,59 @@ int main() {
 			else
 				draw_text(batch, &scene.font, "Cancel", xPos + 55, yPos + 6);
 		}
-		if (state == MAIN_EXIT)
+		//a game is over once it is left, so its recording is complete
+		if (state != MAIN_GAME && replay.recording) {
+			save_replay(&replay, "data/last.replay");
+			replay.recording = false;
+		}
+		if (state == MAIN_EXIT) {
+			if (traceOnExit)
+				dump_trace("trace.json");
 			exit(0);
+		}
+
+		//F5 quicksaves, F8 quickloads, and each new wave autosaves so a crash loses one wave at most
+		if (state == MAIN_GAME) {
+			if (is_key_released(KEY_F5) && save_snapshot(&g, "data/quicksave"))
+				push_notification(&g, "Game saved");
+			if (is_key_released(KEY_F8) && load_snapshot(&g, &scene, "data/quicksave")) {
+				push_notification(&g, "Game loaded");
+				replay.recording = false;
+				replay.playing = false;
+				clear_snapshot_ring(&ring);
+				autosavedWave = g.currentWave;
+			}
+			if (g.currentWave != autosavedWave) {
+				save_snapshot(&g, "data/autosave");
+				autosavedWave = g.currentWave;
+			}
+
+			//F6 rewinds a couple of seconds at a time, F7 starts the current wave over
+			bool rewound = false;
+			if (is_key_released(KEY_F6) && rewind_snapshot(&ring, &g, &scene)) {
+				push_notification(&g, "Rewound");
+				rewound = true;
+			}
+			if (is_key_released(KEY_F7) && retry_wave(&ring, &g, &scene)) {
+				push_notification(&g, "Retrying the wave");
+				rewound = true;
+			}
+			//the recording can't follow the game back in time
+			if (rewound) {
+				replay.recording = false;
+				replay.playing = false;
+				autosavedWave = g.currentWave;
+			}
+			update_snapshot_ring(&ring, &g);
+		}
+		if (is_key_released(KEY_F9))
+			showProfiler = !showProfiler;
+		if (is_key_released(KEY_F10))
+			export_profile_csv("profile.csv");
+		if (is_key_released(KEY_F11))
+			dump_trace("trace.json");
+		if (showProfiler)
+			draw_profiler_overlay(batch, &scene.font, get_window_width() - 570, 80);
 
 		draw_texture(batch, cursor, mouse.x, mouse.y);
 		end2D(batch);
@@ -475,6 +471,9 @@ int main() {
 	dispose_sound(blackmoorTides);
 	dispose_texture(cursor);
 	dispose_batch(batch);
+	dispose_jobs();
 	dispose_window();
+	if (traceOnExit)
+		dump_trace("trace.json");
 	return 0;
 }
\ No newline at end of file
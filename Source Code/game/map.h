@@ -4,12 +4,16 @@
 #include <algorithm>
 #include "utils.h"
 
+#if defined(BMT_USE_LZ4)
+#include <lz4.h>
+#endif
+
 //TODO:
 //
 // KEY: # = not done
 //      X = done
 //
-//# save/load walls correctly
+//X save/load walls correctly
 //X cannons should rotate and shoot at invaders
 //X invaders should attack walls. Perhaps there will be a wobble animation for the unit during the attack? for visual feedback purposes
 //X path steering needs to include walls (and water tiles) in seperation vector calculation
@@ -49,6 +53,7 @@ const i32 BOAT_HP = 25;
 const i32 ANIMATION_DELAY = 7;
 const i32 FIREBALL_RADIUS = 80;
 const i32 SIDEBAR_X_OFFSET = 0;
+const i32 MAP_MAX_SIZE = 4096;
 
 const f32 MAGE_RANGE = 380;
 const f32 STONETHROWER_RANGE = 350;
@@ -121,6 +126,8 @@ struct Unit {
 	i16 hp;
 	i16 maxHp;
 	u8 damage;
+	u16 squad;			//index + 1 into Map::squads, 0 when not in one
+	u16 squadSlot;		//place in the squad's formation
 	Wall* wtarget;
 	GoldPile* gtarget;
 	Owner owner;
@@ -158,8 +165,8 @@ enum ProjectileType {
 };
 
 struct Projectile {
-	i16 x;
-	i16 y;
+	i32 x;
+	i32 y;
 	f32 rotation;
 	ProjectileType type;
 	Owner owner;
@@ -167,11 +174,165 @@ struct Projectile {
 };
 
 struct Explosion {
-	i16 x;
-	i16 y;
+	i32 x;
+	i32 y;
 	Animation animation;
 };
 
+//the textures a unit can be drawn with, see get_sprite
+enum SpriteID {
+	SPRITE_NONE,
+	SPRITE_GREENSHIP,
+	SPRITE_GREENSHIP_DAMAGED,
+	SPRITE_GREENSHIP_WRECKED,
+	SPRITE_REDSHIP,
+	SPRITE_REDSHIP_DAMAGED,
+	SPRITE_REDSHIP_WRECKED,
+	SPRITE_YELLOWSHIP,
+	SPRITE_YELLOWSHIP_DAMAGED,
+	SPRITE_YELLOWSHIP_WRECKED,
+	SPRITE_WHITESHIP,
+	SPRITE_WHITESHIP_DAMAGED,
+	SPRITE_WHITESHIP_WRECKED,
+	SPRITE_BOSS_SHIP,
+	SPRITE_DINGHY,
+	SPRITE_FOOTSOLDIER,
+	SPRITE_ELITE,
+	SPRITE_MAGE,
+	SPRITE_STONETHROWER,
+	SPRITE_EDRIC,
+	SPRITE_GOLIATH,
+	SPRITE_ULTIMATE_BOSS
+};
+
+enum ArchetypeFlags {
+	ARCHETYPE_SHIP = 1 << 0,		//unloads invaders when it reaches the shore and faces the way it is heading
+	ARCHETYPE_MELEE = 1 << 1,		//attacks whatever it walks up to
+	ARCHETYPE_RANGED = 1 << 2,		//stops in range of a wall and throws at it
+	ARCHETYPE_SIEGE = 1 << 3,		//goes for walls even when gold is closer
+	ARCHETYPE_BOULDER = 1 << 4,		//throws a boulder at the first wall it closes in on
+	ARCHETYPE_VOLLEY = 1 << 5,		//each throw also fires at the two closest walls
+	ARCHETYPE_BOSS = 1 << 6,		//lands where its ship is and gets a health bar
+	ARCHETYPE_STRANDED = 1 << 7		//never heads back to its boat
+};
+
+#define ARCHETYPE_MAX_SPAWNS	4
+
+//invaders a ship unloads, count of them with the given hp and damage
+struct SpawnEntry {
+	UnitType type;
+	u8 count;
+	i16 hp;
+	u8 damage;
+};
+
+struct UnitArchetype {
+	const char* name;
+	u32 flags;
+	i16 hp;							//hp it starts with when a wave brings it
+	u16 bounty;
+	f32 range;						//how close a ranged unit gets to its wall
+	f64 throwSpeed;					//how fast a ranged unit winds up, it throws every 16
+	ProjectileType projectile;
+	SpriteID sprites[3];			//healthy, damaged (18 hp or less) and wrecked (10 hp or less)
+	SpriteID rider;					//drawn unrotated on top of the unit
+	SpriteID hitbox;				//what player projectiles test against
+	f32 scale;
+	const char* notification;		//pushed when a wave brings this ship
+	u32 numSpawns;
+	SpawnEntry spawns[ARCHETYPE_MAX_SPAWNS];
+};
+
+#define SHIP_SPRITES(color)	{ SPRITE_##color, SPRITE_##color##_DAMAGED, SPRITE_##color##_WRECKED }
+#define UNIT_SPRITES(sprite)	{ sprite, sprite, sprite }
+
+//everything that differs between unit types, indexed by UnitType
+constexpr UnitArchetype UNIT_ARCHETYPES[] = {
+	//UNIT_DINGHY
+	{ "Dinghy", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_DINGHY), SPRITE_FOOTSOLDIER, SPRITE_FOOTSOLDIER, 1, NULL,
+		1, { { UNIT_FOOTSOLDIER, 3, 4, 2 } } },
+	//UNIT_ELITE_SHIP
+	{ "Elite ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		SHIP_SPRITES(GREENSHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL,
+		2, { { UNIT_FOOTSOLDIER, 1, 4, 2 }, { UNIT_ELITE, 3, 6, 2 } } },
+	//UNIT_MAGE_SHIP
+	{ "Mage ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		SHIP_SPRITES(REDSHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL,
+		2, { { UNIT_FOOTSOLDIER, 2, 4, 2 }, { UNIT_MAGE, 3, 5, 2 } } },
+	//UNIT_STONETHROWER_SHIP
+	{ "Stonethrower ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		SHIP_SPRITES(YELLOWSHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL,
+		2, { { UNIT_FOOTSOLDIER, 2, 4, 2 }, { UNIT_STONETHROWER, 3, 5, 2 } } },
+	//UNIT_RUSH_SHIP
+	{ "Rush ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		SHIP_SPRITES(WHITESHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL,
+		4, { { UNIT_FOOTSOLDIER, 8, 4, 2 }, { UNIT_ELITE, 1, 6, 4 }, { UNIT_MAGE, 1, 6, 4 }, { UNIT_STONETHROWER, 1, 6, 4 } } },
+	//UNIT_GOLIATH_SHIP
+	{ "Goliath's ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_BOSS_SHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1.5, "That ship... the Goliath comes.",
+		1, { { UNIT_GOLIATH, 1, 60, 3 } } },
+	//UNIT_EDRIC_SHIP
+	{ "Edric's ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_BOSS_SHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1.5, "That ship... Edric the Swashbuckling Sorcerer comes.",
+		1, { { UNIT_EDRIC, 1, 55, 20 } } },
+	//UNIT_FOOTSOLDIER
+	{ "Footsoldier", ARCHETYPE_MELEE, 4, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_FOOTSOLDIER), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_STONETHROWER
+	{ "Stonethrower", ARCHETYPE_RANGED | ARCHETYPE_SIEGE, 5, GOLD_BOUNTY, STONETHROWER_RANGE, 0.17, PROJECTILE_STONE,
+		UNIT_SPRITES(SPRITE_STONETHROWER), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_ELITE
+	{ "Elite", ARCHETYPE_MELEE, 6, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_ELITE), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_MAGE
+	{ "Mage", ARCHETYPE_RANGED | ARCHETYPE_SIEGE, 5, GOLD_BOUNTY, MAGE_RANGE, 0.098, PROJECTILE_FIREBALL,
+		UNIT_SPRITES(SPRITE_MAGE), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_GOLIATH
+	{ "GOLIATH", ARCHETYPE_MELEE | ARCHETYPE_SIEGE | ARCHETYPE_BOULDER | ARCHETYPE_BOSS | ARCHETYPE_STRANDED, 60, 360, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_GOLIATH), SPRITE_NONE, SPRITE_GOLIATH, 1, NULL, 0, {} },
+	//UNIT_EDRIC
+	{ "Edric the Swashbuckling Sorcerer", ARCHETYPE_RANGED | ARCHETYPE_SIEGE | ARCHETYPE_VOLLEY | ARCHETYPE_BOSS | ARCHETYPE_STRANDED, 55, 320, STONETHROWER_RANGE, 0.098, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_EDRIC), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_CANNON, never spawned and never drawn
+	{ "Cannon", 0, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_NONE), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1, NULL, 0, {} },
+	//UNIT_ULTIMATE_BOSS
+	{ "???", ARCHETYPE_MELEE | ARCHETYPE_BOSS, 1000, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_ULTIMATE_BOSS), SPRITE_NONE, SPRITE_ULTIMATE_BOSS, 1, NULL, 0, {} },
+	//UNIT_ULTIMATE_BOSS_SHIP
+	{ "The final ship", ARCHETYPE_SHIP, BOAT_HP, GOLD_BOUNTY, 0, 0, PROJECTILE_CANNONBALL,
+		UNIT_SPRITES(SPRITE_BOSS_SHIP), SPRITE_NONE, SPRITE_FOOTSOLDIER, 1.5, NULL,
+		1, { { UNIT_ULTIMATE_BOSS, 1, 1000, 30 } } }
+};
+
+#undef SHIP_SPRITES
+#undef UNIT_SPRITES
+
+#define NUM_UNIT_TYPES	(sizeof(UNIT_ARCHETYPES) / sizeof(UNIT_ARCHETYPES[0]))
+
+static_assert(NUM_UNIT_TYPES == UNIT_ULTIMATE_BOSS_SHIP + 1, "every UnitType needs an archetype");
+
+//types come straight from map files and the levels manifest, so one past the end of the
+//table gets the cannon's archetype, which does nothing
+static inline
+const UnitArchetype* get_archetype(UnitType type) {
+	return (u32)type < NUM_UNIT_TYPES ? &UNIT_ARCHETYPES[type] : &UNIT_ARCHETYPES[UNIT_CANNON];
+}
+
+static inline
+bool has_flag(UnitType type, u32 flag) {
+	return (get_archetype(type)->flags & flag) != 0;
+}
+
+//how many invaders a ship of this type unloads
+constexpr u32 unload_count(UnitType type) {
+	u32 count = 0;
+	for (u32 i = 0; i < UNIT_ARCHETYPES[type].numSpawns; ++i)
+		count += UNIT_ARCHETYPES[type].spawns[i].count;
+	return count;
+}
+
 struct MapScene {
 	Texture redship[3];
 	Texture greenship[3];
@@ -246,16 +407,36 @@ struct MapScene {
 	Texture bigBoss;
 };
 
+//Invaders unloaded by the same boat. The first member to go idle searches for a target,
+//and the others take its plan while it is fresh and its wall still stands, holding their
+//own spot in a formation around the target rather than all seeking the same point.
+struct Squad {
+	vec2 origin;			//where the boat waits, and where members retreat to
+	u32 members;			//recounted every tick, a squad with none is a free slot
+	u32 plannedTick;
+	bool planned;
+	i32 wall;				//index into the walls, -1 for none
+	i32 goldpile;			//index into the gold piles, -1 for none
+	u32 wallx;
+	u32 wally;
+	f32 walldist;
+	f32 golddist;
+};
+
 struct Map {
 	f32 x;
 	f32 y;
 	i16* grid[NUM_LAYERS];
-	u16 width;
-	u16 height;
+	u32 width;
+	u32 height;
 	Wall* walls;
+	MappedFile mapping;
 	std::vector<GoldPile> goldpiles;
 	std::vector<Turret> turrets;
 	std::vector<Unit> units;
+	std::vector<Squad> squads;
+	std::vector<u8> focus;			//cells near the fort, rebuilt every tick by update_focus
+	std::vector<vec2> positions;	//unit positions when steering started, read by the steering jobs
 	std::vector<Projectile> projectiles;
 	std::vector<Explosion> explosions;
 };
@@ -299,6 +480,26 @@ struct Group {
 	Side side;
 };
 
+//everything the player does that changes the simulation goes through a Command, so that a
+//game can be recorded and played back tick for tick (see replay.h)
+enum CommandType {
+	COMMAND_BUILD,
+	COMMAND_SELL,
+	COMMAND_REPAIR,
+	COMMAND_READY,
+	COMMAND_RESET,
+	COMMAND_CAMERA,
+	COMMAND_SET_MONEY
+};
+
+struct Command {
+	u32 tick;
+	u16 type;
+	u16 building;
+	i32 x;
+	i32 y;
+};
+
 struct Game {
 	GameState state;
 	Map map;
@@ -311,6 +512,21 @@ struct Game {
 	u32 currentWave;
 	u32 nextWaveTime;
 	u32 timer;
+	u32 tick;
+	u32 retargetCursor;		//where update_retargeting picks up next tick
+	std::vector<Command> commands;
+};
+
+//the seed and level a game started from, and the commands issued since, in tick order
+struct Replay {
+	u32 seed;
+	i32 level;
+	std::string file;
+	u32 ticks;
+	std::vector<Command> commands;
+	u32 cursor;
+	bool recording;
+	bool playing;
 };
 
 struct Editor {
@@ -340,19 +556,24 @@ void push_status_text(Game* game, vec2 pos, std::string text) {
 }
 
 static inline
-void add_wave(Game* game, const char* params) {
-	std::vector<Group> wave;
-
+Group create_group(UnitType type, Side side) {
 	Unit boat = { 0 };
 	boat.state = UNIT_WALKING;
 	boat.owner = OWNER_INVADERS;
-	boat.hp = boat.maxHp = BOAT_HP;
+	boat.hp = boat.maxHp = get_archetype(type)->hp;
+	boat.type = type;
+	return { boat, side };
+}
+
+static inline
+void add_wave(Game* game, const char* params) {
+	std::vector<Group> wave;
 
 	u32 numTokens = 0;
 	char** tokens = split_string(params, " ", &numTokens);
 
 	for (u16 i = 0; i < numTokens; ++i) {
-		boat.type = (UnitType)(atoi(tokens[i]));
+		UnitType type = (UnitType)(atoi(tokens[i]));
 		Side side;
 		i++;
 		if (tokens[i][0] == 'n')
@@ -364,7 +585,7 @@ void add_wave(Game* game, const char* params) {
 		if (tokens[i][0] == 'e')
 			side = SIDE_EAST;
 
-		wave.push_back({ boat, side });
+		wave.push_back(create_group(type, side));
 	}
 
 	for (u16 i = 0; i < numTokens; ++i)
@@ -389,28 +610,37 @@ vec2 calculate_seek(vec2 dest, Unit* unit) {
 	return desired - unit->velocity;
 }
 
+//pushes the unit at index away from the units and walls near it, going by the positions
+//every unit had when steering started (map->positions). Without units only the walls push
+//it, which is all a reduced fidelity unit (see update_focus) feels
 static inline
-vec2 calculate_seperation(UnitList* list, Map* map, Unit* unit) {
+vec2 calculate_seperation(Map* map, u32 index, bool units = true) {
 	vec2 totalForce = { 0 };
+	vec2 pos = map->positions[index];
 
-	for (u32 i = 0; i < list->size(); ++i) {
-		Unit* a = &(*list)[i];
-		if (a != unit) {
-			f32 distance = getDistanceE(unit->pos.x, unit->pos.y, a->pos.x, a->pos.y);
+	for (u32 i = 0; units && i < map->positions.size(); ++i) {
+		if (i != index) {
+			vec2 other = map->positions[i];
+			f32 distance = getDistanceE(pos.x, pos.y, other.x, other.y);
 			if (distance < MIN_SEPERATION && distance >= 0) {
-				vec2 pushForce = unit->pos - a->pos;
+				vec2 pushForce = pos - other;
 				totalForce = totalForce + (pushForce / 15.0f);
 			}
 		}
 	}
-	for (u32 x = 0; x < map->width; ++x) {
-		for (u32 y = 0; y < map->height; ++y) {
+	//only walls within 50 pixels push, so only the tiles around the unit need checking
+	i32 x0 = std::max(0, (i32)floorf((pos.x - 50) / TILE_SIZE));
+	i32 y0 = std::max(0, (i32)floorf((pos.y - 50) / TILE_SIZE));
+	i32 x1 = std::min((i32)map->width - 1, (i32)floorf((pos.x + 50) / TILE_SIZE));
+	i32 y1 = std::min((i32)map->height - 1, (i32)floorf((pos.y + 50) / TILE_SIZE));
+	for (i32 x = x0; x <= x1; ++x) {
+		for (i32 y = y0; y <= y1; ++y) {
 			Wall* wall = &map->walls[x + y * map->width];
 
 			if (wall->active) {
-				f32 distance = getDistanceE(unit->pos.x, unit->pos.y, x * TILE_SIZE, y * TILE_SIZE);
+				f32 distance = getDistanceE(pos.x, pos.y, x * TILE_SIZE, y * TILE_SIZE);
 				if (distance < 50 && distance >= 0) {
-					vec2 pushForce = unit->pos - V2(x * TILE_SIZE, y * TILE_SIZE);
+					vec2 pushForce = pos - V2(x * TILE_SIZE, y * TILE_SIZE);
 					totalForce = totalForce + (pushForce);
 				}
 			}
@@ -421,6 +651,7 @@ vec2 calculate_seperation(UnitList* list, Map* map, Unit* unit) {
 
 static inline
 MapScene load_scene() {
+	TRACE_SCOPE("load_scene");
 	MapScene scene = { 0 };
 
 	scene.redship[0] = load_texture("data/art/shipred0.png", GL_LINEAR);
@@ -517,77 +748,213 @@ MapScene load_scene() {
 	return scene;
 }
 
+//the walls and the three layers share one allocation, walls first since they need the
+//stricter alignment, so a map is freed with a single dispose_map
 static inline
-Map create_map(i32 width, i32 height) {
+Map create_map(u32 width, u32 height) {
 	Map map = { 0 };
 	map.width = width;
 	map.height = height;
-	for (u16 i = 0; i < NUM_LAYERS; ++i) {
-		map.grid[i] = (i16*)malloc(sizeof(i16)*(width*height));
-		for (u16 j = 0; j < width*height; ++j) {
+
+	u32 size = width * height;
+	u8* block = (u8*)malloc(sizeof(Wall) * size + sizeof(i16) * size * NUM_LAYERS);
+	if (block == NULL)
+		BMT_LOG(FATAL_ERROR, "Could not allocate a %dx%d map", width, height);
+
+	map.walls = (Wall*)block;
+	for (u32 i = 0; i < size; ++i) {
+		map.walls[i] = { 0 };
+	}
+	for (u32 i = 0; i < NUM_LAYERS; ++i) {
+		map.grid[i] = (i16*)(block + sizeof(Wall) * size) + i * size;
+		for (u32 j = 0; j < size; ++j) {
 			map.grid[i][j] = 72;
 		}
 	}
-	map.walls = (Wall*)malloc(sizeof(Wall) * (width*height));
-	for (u16 i = 0; i < width*height; ++i) {
-		map.walls[i] = { 0 };
-	}
 	return map;
 }
 
+//walls always start the allocation, and a mapped binary map's layers live in its mapping
+static inline
+void dispose_map(Map* map) {
+	free(map->walls);
+	map->walls = NULL;
+	unmap_file(&map->mapping);
+	for (u32 i = 0; i < NUM_LAYERS; ++i)
+		map->grid[i] = NULL;
+	map->width = 0;
+	map->height = 0;
+	map->goldpiles.clear();
+	map->turrets.clear();
+	map->units.clear();
+	map->squads.clear();
+	map->focus.clear();
+	map->projectiles.clear();
+	map->explosions.clear();
+}
+
+//picks the wall sprite for the tile at x, y from which of its four neighbours are walls
+static inline
+void orient_wall(Map* map, i32 x, i32 y) {
+	i32 width = (i32)map->width;
+	i32 height = (i32)map->height;
+	Wall* curr = &map->walls[x + y * width];
+	if (x + 1 < width && map->walls[(x + 1) + y * width].active) {
+		curr->adjacency = 10;
+	}
+	if (x - 1 >= 0 && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 9;
+	}
+	if (y + 1 < height && map->walls[x + (y + 1) * width].active) {
+		curr->adjacency = 7;
+	}
+	if (y - 1 >= 0 && map->walls[x + (y - 1) * width].active) {
+		curr->adjacency = 8;
+	}
+	if (x + 1 < width && x - 1 >= 0 && map->walls[(x + 1) + y * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 1;
+	}
+	if (y + 1 < height && y - 1 >= 0 && map->walls[x + (y + 1) * width].active && map->walls[x + (y - 1) * width].active) {
+		curr->adjacency = 0;
+	}
+	if (y + 1 < height && x + 1 < width && map->walls[x + (y + 1) * width].active && map->walls[(x + 1) + y * width].active) {
+		curr->adjacency = 11;
+	}
+	if (y + 1 < height && x - 1 >= 0 && map->walls[x + (y + 1) * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 12;
+	}
+	if (y - 1 >= 0 && x + 1 < width && map->walls[x + (y - 1) * width].active && map->walls[(x + 1) + y * width].active) {
+		curr->adjacency = 13;
+	}
+	if (y - 1 >= 0 && x - 1 >= 0 && map->walls[x + (y - 1) * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 14;
+	}
+	if (y + 1 < height && y - 1 >= 0 && x - 1 >= 0 && map->walls[x + (y + 1) * width].active && map->walls[x + (y - 1) * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 4;
+	}
+	if (y + 1 < height && y - 1 >= 0 && x + 1 < width && map->walls[x + (y + 1) * width].active && map->walls[x + (y - 1) * width].active && map->walls[(x + 1) + y * width].active) {
+		curr->adjacency = 5;
+	}
+	if (y + 1 < height && x + 1 < width && x - 1 >= 0 && map->walls[x + (y + 1) * width].active && map->walls[(x + 1) + y * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 2;
+	}
+	if (y - 1 >= 0 && x + 1 < width && x - 1 >= 0 && map->walls[x + (y - 1) * width].active && map->walls[(x + 1) + y * width].active && map->walls[(x - 1) + y * width].active) {
+		curr->adjacency = 3;
+	}
+	if (y + 1 < height && x + 1 < width && x - 1 >= 0 && y - 1 >= 0 && map->walls[x + (y + 1) * width].active && map->walls[(x + 1) + y * width].active && map->walls[(x - 1) + y * width].active && map->walls[x + (y - 1) * width].active) {
+		curr->adjacency = 17;
+	}
+	if (y + 1 < height && x + 1 < width && x - 1 >= 0 && y - 1 >= 0 && !map->walls[x + (y + 1) * width].active && !map->walls[(x + 1) + y * width].active && !map->walls[(x - 1) + y * width].active && !map->walls[x + (y - 1) * width].active) {
+		curr->adjacency = 6;
+	}
+}
+
+//every tile on the map, for when the walls are loaded or replaced wholesale
 static inline
 void orient_walls(Map* map) {
-	for (i32 x = 0; x < map->width; ++x) {
-		for (i32 y = 0; y < map->height; ++y) {
-			Wall* curr = &map->walls[x + y * map->width];
-			if (x + 1 < map->width && map->walls[(x + 1) + y * map->width].active) {
-				curr->adjacency = 10;
-			}
-			if (x - 1 >= 0 && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 9;
-			}
-			if (y + 1 < map->height && map->walls[x + (y + 1) * map->width].active) {
-				curr->adjacency = 7;
-			}
-			if (y - 1 >= 0 && map->walls[x + (y - 1) * map->width].active) {
-				curr->adjacency = 8;
-			}
-			if (x + 1 < map->width && x - 1 >= 0 && map->walls[(x + 1) + y * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 1;
-			}
-			if (y + 1 < map->height && y - 1 >= 0 && map->walls[x + (y + 1) * map->width].active && map->walls[x + (y - 1) * map->width].active) {
-				curr->adjacency = 0;
-			}
-			if (y + 1 < map->height && x + 1 < map->width && map->walls[x + (y + 1) * map->width].active && map->walls[(x + 1) + y * map->width].active) {
-				curr->adjacency = 11;
-			}
-			if (y + 1 < map->height && x - 1 >= 0 && map->walls[x + (y + 1) * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 12;
-			}
-			if (y - 1 >= 0 && x + 1 < map->width && map->walls[x + (y - 1) * map->width].active && map->walls[(x + 1) + y * map->width].active) {
-				curr->adjacency = 13;
-			}
-			if (y - 1 >= 0 && x - 1 >= 0 && map->walls[x + (y - 1) * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 14;
-			}
-			if (y + 1 < map->height && y - 1 >= 0 && x - 1 >= 0 && map->walls[x + (y + 1) * map->width].active && map->walls[x + (y - 1) * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 4;
-			}
-			if (y + 1 < map->height && y - 1 >= 0 && x + 1 < map->width && map->walls[x + (y + 1) * map->width].active && map->walls[x + (y - 1) * map->width].active && map->walls[(x + 1) + y * map->width].active) {
-				curr->adjacency = 5;
-			}
-			if (y + 1 < map->height && x + 1 < map->width && x - 1 >= 0 && map->walls[x + (y + 1) * map->width].active && map->walls[(x + 1) + y * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 2;
-			}
-			if (y - 1 >= 0 && x + 1 < map->width && x - 1 >= 0 && map->walls[x + (y - 1) * map->width].active && map->walls[(x + 1) + y * map->width].active && map->walls[(x - 1) + y * map->width].active) {
-				curr->adjacency = 3;
-			}
-			if (y + 1 < map->height && x + 1 < map->width && x - 1 >= 0 && y - 1 >= 0 && map->walls[x + (y + 1) * map->width].active && map->walls[(x + 1) + y * map->width].active && map->walls[(x - 1) + y * map->width].active && map->walls[x + (y - 1) * map->width].active) {
-				curr->adjacency = 17;
-			}
-			if (y + 1 < map->height && x + 1 < map->width && x - 1 >= 0 && y - 1 >= 0 && !map->walls[x + (y + 1) * map->width].active && !map->walls[(x + 1) + y * map->width].active && !map->walls[(x - 1) + y * map->width].active && !map->walls[x + (y - 1) * map->width].active) {
-				curr->adjacency = 6;
-			}
+	for (i32 x = 0; x < (i32)map->width; ++x) {
+		for (i32 y = 0; y < (i32)map->height; ++y)
+			orient_wall(map, x, y);
+	}
+}
+
+//after a single wall is built or removed only it and its neighbours can change sprite
+static inline
+void orient_walls_around(Map* map, i32 x, i32 y) {
+	for (i32 ny = std::max(y - 1, 0); ny <= std::min(y + 1, (i32)map->height - 1); ++ny) {
+		for (i32 nx = std::max(x - 1, 0); nx <= std::min(x + 1, (i32)map->width - 1); ++nx)
+			orient_wall(map, nx, ny);
+	}
+}
+
+//returns the part of the map the camera can see, in map coordinates
+static inline
+Rect get_camera_rect(Map* map) {
+	return { -map->x, -map->y, (f32)get_window_width(), (f32)get_window_height() };
+}
+
+static inline
+bool on_screen(Map* map, f32 x, f32 y, f32 width, f32 height) {
+	return colliding(get_camera_rect(map), x, y, width, height);
+}
+
+//sprites drawn with draw_texture_rotated spin around their center, so test the box that
+//contains them at any angle rather than the unrotated one.
+static inline
+bool on_screen_rotated(Map* map, f32 x, f32 y, f32 width, f32 height) {
+	f32 radius = sqrtf((width * width) + (height * height)) / 2;
+	return on_screen(map, x + (width / 2) - radius, y + (height / 2) - radius, radius * 2, radius * 2);
+}
+
+static inline
+Texture get_sprite(MapScene* scene, SpriteID sprite) {
+	switch (sprite) {
+	case SPRITE_GREENSHIP: return scene->greenship[0];
+	case SPRITE_GREENSHIP_DAMAGED: return scene->greenship[1];
+	case SPRITE_GREENSHIP_WRECKED: return scene->greenship[2];
+	case SPRITE_REDSHIP: return scene->redship[0];
+	case SPRITE_REDSHIP_DAMAGED: return scene->redship[1];
+	case SPRITE_REDSHIP_WRECKED: return scene->redship[2];
+	case SPRITE_YELLOWSHIP: return scene->yellowship[0];
+	case SPRITE_YELLOWSHIP_DAMAGED: return scene->yellowship[1];
+	case SPRITE_YELLOWSHIP_WRECKED: return scene->yellowship[2];
+	case SPRITE_WHITESHIP: return scene->whiteship[0];
+	case SPRITE_WHITESHIP_DAMAGED: return scene->whiteship[1];
+	case SPRITE_WHITESHIP_WRECKED: return scene->whiteship[2];
+	case SPRITE_BOSS_SHIP: return scene->bossShip;
+	case SPRITE_DINGHY: return scene->dinghyLarge[0];
+	case SPRITE_FOOTSOLDIER: return scene->attackers[0];
+	case SPRITE_ELITE: return scene->attackers[1];
+	case SPRITE_MAGE: return scene->attackerMage;
+	case SPRITE_STONETHROWER: return scene->attackerStonethrower;
+	case SPRITE_EDRIC: return scene->edric;
+	case SPRITE_GOLIATH: return scene->goliath;
+	case SPRITE_ULTIMATE_BOSS: return scene->bigBoss;
+	default: break;
+	}
+	Texture none = { 0 };
+	return none;
+}
+
+//the sprite for how damaged the unit is, scaled to the size it is drawn at
+static inline
+Texture get_unit_sprite(MapScene* scene, Unit* unit) {
+	const UnitArchetype* archetype = get_archetype(unit->type);
+	Texture tex = get_sprite(scene, archetype->sprites[unit->hp > 18 ? 0 : unit->hp > 10 ? 1 : 2]);
+	tex.width *= archetype->scale;
+	tex.height *= archetype->scale;
+	return tex;
+}
+
+static inline
+bool unit_on_screen(Map* map, MapScene* scene, Unit* unit) {
+	Texture tex = get_unit_sprite(scene, unit);
+	return on_screen_rotated(map, unit->pos.x, unit->pos.y, tex.width, tex.height);
+}
+
+//removes a wall that has run out of hp, along with any turret sitting on it
+static inline
+void destroy_wall(Map* map, MapScene* scene, u32 x, u32 y) {
+	Wall* wall = &map->walls[x + y * map->width];
+	if (!wall->active)
+		return;
+
+	play_sound(scene->explosionBang);
+
+	wall->active = false;
+	Explosion explosion = { 0 };
+	explosion.animation = create_animation("explode", scene->explosion, 5, 74, 75, ANIMATION_DELAY);
+	explosion.x = (x*TILE_SIZE) + (TILE_SIZE / 2) - (74 / 2);
+	explosion.y = (y*TILE_SIZE) + (TILE_SIZE / 2) - (75 / 2);
+	map->explosions.push_back(explosion);
+	orient_walls_around(map, x, y);
+
+	//remove cannon if there is one on top of the wall
+	for (u16 i = 0; i < map->turrets.size(); ++i) {
+		Turret* turret = &map->turrets[i];
+		if (turret->x == (i32)x && turret->y == (i32)y) {
+			map->turrets.erase(map->turrets.begin() + i);
+			break;
 		}
 	}
 }
@@ -607,6 +974,9 @@ void draw_map(RenderBatch* batch, Map* map, MapScene* scene) {
 	clamp(x1, 0, map->width);
 	clamp(y1, 0, map->height);
 
+	//only entities count as culled. Tiles and walls outside the view are never visited, and
+	//on a large map they would bury the entity numbers anyway
+
 	Rect dest;
 	dest.width = TILE_SIZE;
 	dest.height = TILE_SIZE;
@@ -621,8 +991,8 @@ void draw_map(RenderBatch* batch, Map* map, MapScene* scene) {
 	i32 mapy = (i32)map->y;
 
 	//draw water tiles
-	for (u16 y = y0; y < y1; ++y) {
-		for (u16 x = x0; x < x1; ++x) {
+	for (i32 y = y0; y < y1; ++y) {
+		for (i32 x = x0; x < x1; ++x) {
 			dest.x = (x * (TILE_SIZE)) + mapx;
 			dest.y = (y * (TILE_SIZE)) + mapy;
 			src.x = 72 % num_tiles_across;
@@ -635,8 +1005,8 @@ void draw_map(RenderBatch* batch, Map* map, MapScene* scene) {
 
 	//draw all other tiles above that, leave blank if water tile
 	for (u8 i = 0; i < NUM_LAYERS; ++i) {
-		for (u16 y = y0; y < y1; ++y) {
-			for (u16 x = x0; x < x1; ++x) {
+		for (i32 y = y0; y < y1; ++y) {
+			for (i32 x = x0; x < x1; ++x) {
 				i32 id = map->grid[i][x + y * map->width];
 
 				if (id != 72) {
@@ -653,184 +1023,390 @@ void draw_map(RenderBatch* batch, Map* map, MapScene* scene) {
 	}
 
 	//draw walls, if active (existing)
-	for (u16 y = 0; y < map->height; ++y) {
-		for (u16 x = 0; x < map->width; ++x) {
+	for (i32 y = y0; y < y1; ++y) {
+		for (i32 x = x0; x < x1; ++x) {
 			Wall* curr = &map->walls[x + y * map->width];
 
 			if (curr->active) {
-				//remove wall if its hp went to 0
-				if (curr->hp <= 0) {
-					play_sound(scene->explosionBang);
-
-					curr->active = false;
-					Explosion explosion = { 0 };
-					explosion.animation = create_animation("explode", scene->explosion, 5, 74, 75, ANIMATION_DELAY);
-					explosion.x = (x*TILE_SIZE) + (TILE_SIZE / 2) - (74 / 2);
-					explosion.y = (y*TILE_SIZE) + (TILE_SIZE / 2) - (75 / 2);
-					map->explosions.push_back(explosion);
-					orient_walls(map);
-
-					//remove cannon if there is one on top of the wall
-					for (u16 i = 0; i < map->turrets.size(); ++i) {
-						Turret* turret = &map->turrets[i];
-						if (turret->x == x && turret->y == y) {
-							map->turrets.erase(map->turrets.begin() + i);
-							break;
-						}
-					}
-				}
-
-				if (x > x0 - 1 && x < x1 && y > y0 - 1 && y < y1) {
-					dest.x = (x * (TILE_SIZE)) + mapx;
-					dest.y = (y * (TILE_SIZE)) + mapy;
-					src.x = curr->adjacency * TILE_SIZE;
-					src.y = 0;
-					if (curr->hp < WALL_HP / 2)
-						draw_texture_EX(batch, scene->walls_damaged, src, dest);
-					else
-						draw_texture_EX(batch, scene->walls, src, dest);
-				}
+				dest.x = (x * (TILE_SIZE)) + mapx;
+				dest.y = (y * (TILE_SIZE)) + mapy;
+				src.x = curr->adjacency * TILE_SIZE;
+				src.y = 0;
+				if (curr->hp < WALL_HP / 2)
+					draw_texture_EX(batch, scene->walls_damaged, src, dest);
+				else
+					draw_texture_EX(batch, scene->walls, src, dest);
 			}
 		}
 	}
 
 	for (u16 i = 0; i < map->goldpiles.size(); ++i) {
 		GoldPile* curr = &map->goldpiles[i];
+		if (curr->x < x0 || curr->x >= x1 || curr->y < y0 || curr->y >= y1) {
+			add_culled_sprites(batch);
+			continue;
+		}
 		draw_texture_EX(batch, scene->goldpile, { (f32)(curr->coins - 1) * TILE_SIZE, 0, (f32)TILE_SIZE, (f32)TILE_SIZE }, { (f32)(curr->x * TILE_SIZE) + map->x, (f32)(curr->y * TILE_SIZE) + map->y, (f32)TILE_SIZE, (f32)TILE_SIZE });
 	}
 
 	//draw units
 	for (u16 i = 0; i < map->units.size(); ++i) {
 		Unit* curr = &map->units[i];
+		const UnitArchetype* archetype = get_archetype(curr->type);
+		if (archetype->sprites[0] == SPRITE_NONE)
+			continue;
+
+		Texture tex = get_unit_sprite(scene, curr);
+		if (!on_screen_rotated(map, curr->pos.x, curr->pos.y, tex.width, tex.height)) {
+			add_culled_sprites(batch);
+			continue;
+		}
+
 		i32 xPos = curr->pos.x + mapx;
 		i32 yPos = curr->pos.y + mapy;
 
-		if (curr->type == UNIT_ELITE_SHIP) {
-			if (curr->hp > 18)
-				draw_texture_rotated(batch, scene->greenship[0], xPos, yPos, curr->rotation);
-			if (curr->hp <= 18 && curr->hp > 10)
-				draw_texture_rotated(batch, scene->greenship[1], xPos, yPos, curr->rotation);
-			if (curr->hp <= 10)
-				draw_texture_rotated(batch, scene->greenship[2], xPos, yPos, curr->rotation);
-		}
-		if (curr->type == UNIT_MAGE_SHIP) {
-			if (curr->hp > 18)
-				draw_texture_rotated(batch, scene->redship[0], xPos, yPos, curr->rotation);
-			if (curr->hp <= 18 && curr->hp > 10)
-				draw_texture_rotated(batch, scene->redship[1], xPos, yPos, curr->rotation);
-			if (curr->hp <= 10)
-				draw_texture_rotated(batch, scene->redship[2], xPos, yPos, curr->rotation);
-		}
-		if (curr->type == UNIT_STONETHROWER_SHIP) {
-			if (curr->hp > 18)
-				draw_texture_rotated(batch, scene->yellowship[0], xPos, yPos, curr->rotation);
-			if (curr->hp <= 18 && curr->hp > 10)
-				draw_texture_rotated(batch, scene->yellowship[1], xPos, yPos, curr->rotation);
-			if (curr->hp <= 10)
-				draw_texture_rotated(batch, scene->yellowship[2], xPos, yPos, curr->rotation);
-		}
-		if (curr->type == UNIT_RUSH_SHIP) {
-			if (curr->hp > 18)
-				draw_texture_rotated(batch, scene->whiteship[0], xPos, yPos, curr->rotation);
-			if (curr->hp <= 18 && curr->hp > 10)
-				draw_texture_rotated(batch, scene->whiteship[1], xPos, yPos, curr->rotation);
-			if (curr->hp <= 10)
-				draw_texture_rotated(batch, scene->whiteship[2], xPos, yPos, curr->rotation);
-		}
-		if (curr->type == UNIT_GOLIATH_SHIP || curr->type == UNIT_EDRIC_SHIP || curr->type == UNIT_ULTIMATE_BOSS_SHIP) {
-			scene->bossShip.width *= 1.5;
-			scene->bossShip.height *= 1.5;
-			draw_texture_rotated(batch, scene->bossShip, xPos, yPos, curr->rotation);
-			scene->bossShip.width /= 1.5;
-			scene->bossShip.height /= 1.5;
-		}
-		if (curr->type == UNIT_DINGHY) {
-			draw_texture_rotated(batch, scene->dinghyLarge[0], xPos, yPos, curr->rotation);
-			draw_texture_rotated(batch, scene->attackers[0],
-				xPos - (scene->attackers[0].width / 6),
-				yPos - (scene->attackers[0].height / 6), 0);
+		//ships face where they are heading, everyone else wobbles as they walk and attack
+		f32 rotation = (archetype->flags & ARCHETYPE_SHIP) ? curr->rotation : sin(curr->rotation) * 16;
+		draw_texture_rotated(batch, tex, xPos, yPos, rotation);
+
+		if (archetype->rider != SPRITE_NONE) {
+			Texture rider = get_sprite(scene, archetype->rider);
+			draw_texture_rotated(batch, rider, xPos - (rider.width / 6), yPos - (rider.height / 6), 0);
 		}
-		if (curr->type == UNIT_STONETHROWER) {
-			draw_texture_rotated(batch, scene->attackerStonethrower, xPos, yPos, sin(curr->rotation) * 16);
+	}
+}
+
+//binary maps: a header, a table of sections, then each section's data starting on a
+//16 byte boundary, all little endian. The layers are stored exactly as Map::grid holds
+//them, so an uncompressed file is mapped and the grid points straight into it.
+#define MAP_FILE_VERSION	1
+#define MAP_FILE_ALIGN		16
+
+GLOBAL const char MAP_FILE_MAGIC[4] = { 'B', 'M', 'A', 'P' };
+
+enum MapSectionType {
+	MAP_SECTION_LAYERS,		//i16[NUM_LAYERS][width * height]
+	MAP_SECTION_WALLS,		//MapFileWall[]
+	MAP_SECTION_UNITS,		//MapFileUnit[]
+	MAP_SECTION_GOLDPILES,	//MapFileGoldPile[]
+	MAP_SECTION_TURRETS,	//MapFileTurret[]
+	MAP_SECTION_WAVES,		//u32 waves, then per wave a u32 count and MapFileBoat[count]
+	MAP_SECTION_COUNT
+};
+
+enum MapCompression {
+	MAP_COMPRESSION_NONE,
+	MAP_COMPRESSION_LZ4
+};
+
+struct MapFileHeader {
+	char magic[4];
+	u32 version;
+	u32 width;
+	u32 height;
+	u32 money;
+	u32 nextWaveTime;
+	u32 numSections;
+	u32 reserved;
+};
+
+struct MapFileSection {
+	u32 type;
+	u32 compression;
+	u64 offset;
+	u64 size;		//bytes in the file
+	u64 rawSize;	//bytes once decompressed
+};
+
+struct MapFileWall { i32 x, y, hp, gate; };
+struct MapFileUnit { f32 x, y; i32 hp, maxHp, type, owner; };
+struct MapFileGoldPile { i32 x, y, coins; };
+struct MapFileTurret { i32 x, y, type, shotDelay; };
+struct MapFileBoat { i32 type, side; };
+
+static inline
+bool is_map_binary(const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return false;
+	char magic[4] = { 0 };
+	size_t read = fread(magic, 1, 4, file);
+	fclose(file);
+	return read == 4 && memcmp(magic, MAP_FILE_MAGIC, 4) == 0;
+}
+
+//returns the section's bytes, either in place in the file or decompressed into storage
+static inline
+const u8* read_map_section(const char* filename, MappedFile* file, MapFileSection* section, std::vector<u8>* storage) {
+	if (section->offset > file->size || section->size > file->size - section->offset)
+		BMT_LOG(FATAL_ERROR, "[%s] Section %d runs past the end of the file", filename, section->type);
+
+	const u8* data = file->data + section->offset;
+	if (section->compression == MAP_COMPRESSION_NONE) {
+		if (section->size != section->rawSize)
+			BMT_LOG(FATAL_ERROR, "[%s] Section %d has mismatched sizes", filename, section->type);
+		return data;
+	}
+	if (section->compression != MAP_COMPRESSION_LZ4)
+		BMT_LOG(FATAL_ERROR, "[%s] Section %d has unknown compression %d", filename, section->type, section->compression);
+
+#if defined(BMT_USE_LZ4)
+	storage->resize(section->rawSize);
+	i32 size = LZ4_decompress_safe((const char*)data, (char*)storage->data(), (i32)section->size, (i32)section->rawSize);
+	if (size < 0 || (u64)size != section->rawSize)
+		BMT_LOG(FATAL_ERROR, "[%s] Section %d is corrupt", filename, section->type);
+	return storage->data();
+#else
+	BMT_LOG(FATAL_ERROR, "[%s] Section %d is LZ4 compressed, build with BMT_USE_LZ4 to read it", filename, section->type);
+	return NULL;
+#endif
+}
+
+//reads a binary map, and the scenario sections into game if it isn't NULL. Uncompressed
+//layers stay in the mapped file, which the map keeps until dispose_map.
+static inline
+Map read_map_binary(const char* filename, Game* game) {
+	TRACE_SCOPE("read_map_binary");
+	Map map = { 0 };
+
+	MappedFile file;
+	if (!map_file(filename, &file))
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
+
+	if (file.size < sizeof(MapFileHeader))
+		BMT_LOG(FATAL_ERROR, "[%s] File is too short for a map header", filename);
+	MapFileHeader* header = (MapFileHeader*)file.data;
+	if (memcmp(header->magic, MAP_FILE_MAGIC, 4) != 0)
+		BMT_LOG(FATAL_ERROR, "[%s] Not a binary map", filename);
+	if (header->version != MAP_FILE_VERSION)
+		BMT_LOG(FATAL_ERROR, "[%s] Map version %d, expected %d", filename, header->version, MAP_FILE_VERSION);
+	if (header->width == 0 || header->height == 0 || header->width > MAP_MAX_SIZE || header->height > MAP_MAX_SIZE)
+		BMT_LOG(FATAL_ERROR, "[%s] Map size %dx%d is not between 1x1 and %dx%d", filename, header->width, header->height, MAP_MAX_SIZE, MAP_MAX_SIZE);
+	if (header->numSections > (file.size - sizeof(MapFileHeader)) / sizeof(MapFileSection))
+		BMT_LOG(FATAL_ERROR, "[%s] Section table runs past the end of the file", filename);
+
+	u32 width = header->width;
+	u32 height = header->height;
+	u32 size = width * height;
+	MapFileSection* sections = (MapFileSection*)(file.data + sizeof(MapFileHeader));
+	std::vector<u8> storage;
+
+	bool hasLayers = false;
+	for (u32 s = 0; s < header->numSections; ++s) {
+		MapFileSection* section = &sections[s];
+		if (section->type != MAP_SECTION_LAYERS)
+			continue;
+		if (hasLayers)
+			BMT_LOG(FATAL_ERROR, "[%s] Map has more than one layers section", filename);
+		if (section->rawSize != (u64)size * NUM_LAYERS * sizeof(i16))
+			BMT_LOG(FATAL_ERROR, "[%s] Layers are %d bytes, expected %d", filename, (i32)section->rawSize, size * NUM_LAYERS * (i32)sizeof(i16));
+
+		if (section->compression == MAP_COMPRESSION_NONE && section->offset % alignof(i16) == 0) {
+			const u8* data = read_map_section(filename, &file, section, &storage);
+			map.width = width;
+			map.height = height;
+			map.walls = (Wall*)calloc(size, sizeof(Wall));
+			for (u32 i = 0; i < NUM_LAYERS; ++i)
+				map.grid[i] = (i16*)data + i * size;
+			map.mapping = file;
 		}
-		if (curr->type == UNIT_MAGE) {
-			draw_texture_rotated(batch, scene->attackerMage, xPos, yPos, sin(curr->rotation) * 16);
+		else {
+			//the layers follow one another in create_map's block, just as they do in the file
+			map = create_map(width, height);
+			const u8* data = read_map_section(filename, &file, section, &storage);
+			memcpy(map.grid[0], data, section->rawSize);
 		}
-		if (curr->type == UNIT_EDRIC) {
-			draw_texture_rotated(batch, scene->edric, xPos, yPos, sin(curr->rotation) * 16);
+		hasLayers = true;
+	}
+	if (!hasLayers)
+		BMT_LOG(FATAL_ERROR, "[%s] Map has no layers", filename);
+
+	for (u32 s = 0; s < header->numSections; ++s) {
+		MapFileSection* section = &sections[s];
+		if (section->type == MAP_SECTION_LAYERS)
+			continue;
+		if (game == NULL && section->type == MAP_SECTION_WAVES)
+			continue;
+
+		const u8* data = read_map_section(filename, &file, section, &storage);
+		u64 rawSize = section->rawSize;
+
+		if (section->type == MAP_SECTION_WALLS) {
+			const MapFileWall* walls = (const MapFileWall*)data;
+			for (u32 i = 0; i < rawSize / sizeof(MapFileWall); ++i) {
+				if (walls[i].x < 0 || walls[i].y < 0 || (u32)walls[i].x >= width || (u32)walls[i].y >= height) {
+					BMT_LOG(WARNING, "[%s] Wall at %d, %d is outside the map", filename, walls[i].x, walls[i].y);
+					continue;
+				}
+				Wall* wall = &map.walls[walls[i].x + walls[i].y * width];
+				wall->active = true;
+				wall->gate = walls[i].gate != 0;
+				wall->hp = walls[i].hp;
+			}
 		}
-		if (curr->type == UNIT_FOOTSOLDIER) {
-			draw_texture_rotated(batch, scene->attackers[0], xPos, yPos, sin(curr->rotation) * 16);
+		else if (section->type == MAP_SECTION_UNITS) {
+			const MapFileUnit* units = (const MapFileUnit*)data;
+			for (u32 i = 0; i < rawSize / sizeof(MapFileUnit); ++i) {
+				Unit unit = { 0 };
+				unit.pos = { units[i].x, units[i].y };
+				unit.hp = units[i].hp;
+				unit.maxHp = units[i].maxHp;
+				unit.type = (UnitType)units[i].type;
+				unit.owner = (Owner)units[i].owner;
+				map.units.push_back(unit);
+			}
 		}
-		if (curr->type == UNIT_ELITE) {
-			draw_texture_rotated(batch, scene->attackers[1], xPos, yPos, sin(curr->rotation) * 16);
+		else if (section->type == MAP_SECTION_GOLDPILES) {
+			const MapFileGoldPile* piles = (const MapFileGoldPile*)data;
+			for (u32 i = 0; i < rawSize / sizeof(MapFileGoldPile); ++i) {
+				if (piles[i].x < 0 || piles[i].y < 0 || (u32)piles[i].x >= width || (u32)piles[i].y >= height) {
+					BMT_LOG(WARNING, "[%s] Gold pile at %d, %d is outside the map", filename, piles[i].x, piles[i].y);
+					continue;
+				}
+				map.goldpiles.push_back({ (i16)piles[i].x, (i16)piles[i].y, (u8)piles[i].coins });
+			}
 		}
-		if (curr->type == UNIT_GOLIATH) {
-			draw_texture_rotated(batch, scene->goliath, xPos, yPos, sin(curr->rotation) * 16);
+		else if (section->type == MAP_SECTION_TURRETS) {
+			const MapFileTurret* turrets = (const MapFileTurret*)data;
+			for (u32 i = 0; i < rawSize / sizeof(MapFileTurret); ++i) {
+				if (turrets[i].x < 0 || turrets[i].y < 0 || (u32)turrets[i].x >= width || (u32)turrets[i].y >= height) {
+					BMT_LOG(WARNING, "[%s] Turret at %d, %d is outside the map", filename, turrets[i].x, turrets[i].y);
+					continue;
+				}
+				Turret turret = { 0 };
+				turret.x = turrets[i].x;
+				turret.y = turrets[i].y;
+				turret.type = (TurretType)turrets[i].type;
+				turret.shotDelay = turrets[i].shotDelay;
+				map.turrets.push_back(turret);
+			}
 		}
-		if (curr->type == UNIT_ULTIMATE_BOSS) {
-			draw_texture_rotated(batch, scene->bigBoss, xPos, yPos, sin(curr->rotation) * 16);
+		else if (section->type == MAP_SECTION_WAVES) {
+			const u8* end = data + rawSize;
+			u32 waves = 0;
+			if (rawSize >= sizeof(u32)) {
+				memcpy(&waves, data, sizeof(u32));
+				data += sizeof(u32);
+			}
+			for (u32 w = 0; w < waves; ++w) {
+				u32 count = 0;
+				if (end - data < (i64)sizeof(u32))
+					BMT_LOG(FATAL_ERROR, "[%s] Wave %d is cut short", filename, w);
+				memcpy(&count, data, sizeof(u32));
+				data += sizeof(u32);
+				if ((u64)(end - data) < (u64)count * sizeof(MapFileBoat))
+					BMT_LOG(FATAL_ERROR, "[%s] Wave %d is cut short", filename, w);
+
+				std::vector<Group> wave;
+				const MapFileBoat* boats = (const MapFileBoat*)data;
+				for (u32 i = 0; i < count; ++i)
+					wave.push_back(create_group((UnitType)boats[i].type, (Side)boats[i].side));
+				data += count * sizeof(MapFileBoat);
+				game->waves.push_back(wave);
+			}
 		}
 	}
+
+	if (game != NULL) {
+		game->money = header->money;
+		game->nextWaveTime = header->nextWaveTime;
+	}
+	//the map only holds on to the file when its layers point into it
+	if (map.mapping.data == NULL)
+		unmap_file(&file);
+	return map;
+}
+
+static inline
+Map load_map_binary(const char* filename) {
+	return read_map_binary(filename, NULL);
+}
+
+static inline
+Game load_scenario_binary(const char* filename) {
+	Game game = { GAME_MENU };
+	game.map = read_map_binary(filename, &game);
+	orient_walls(&game.map);
+	return game;
 }
 
 static inline
 Map load_map(const char* filename) {
+	//binary maps from map_convert load through the same call
+	if (is_map_binary(filename))
+		return load_map_binary(filename);
+
 	Map map = { 0 };
 
 	FILE *file = fopen(filename, "r");
 	if (file == NULL)
-		BMT_LOG(FATAL_ERROR, "Error opening file");
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
 
 	char buffer[255];
 	fgets(buffer, 255, file);
 	fgets(buffer, 255, file);
 
-	i32 width;
-	i32 height;
+	i32 width = 0;
+	i32 height = 0;
 	fscanf(file, "%d", &width);
 	fscanf(file, "%d", &height);
+	if (width <= 0 || height <= 0 || width > MAP_MAX_SIZE || height > MAP_MAX_SIZE)
+		BMT_LOG(FATAL_ERROR, "[%s] Map size %dx%d is not between 1x1 and %dx%d", filename, width, height, MAP_MAX_SIZE, MAP_MAX_SIZE);
 	map = create_map(width, height);
-	for (u16 i = 0; i < width * height; ++i) {
-		i32 id;
-		fscanf(file, "%d", &id);
-		map.grid[0][i] = id;
-	}
-
-	fgets(buffer, 255, file);
-	fgets(buffer, 255, file);
-	for (u16 i = 0; i < width * height; ++i) {
-		i32 id;
-		fscanf(file, "%d", &id);
-		map.grid[1][i] = id;
-	}
 
-	fgets(buffer, 255, file);
-	fgets(buffer, 255, file);
-	for (u16 i = 0; i < width * height; ++i) {
-		i32 id;
-		fscanf(file, "%d", &id);
-		map.grid[2][i] = id;
+	u32 size = (u32)width * height;
+	for (u32 layer = 0; layer < NUM_LAYERS; ++layer) {
+		//skip the rest of the last line and the #layer header, the first header was read above
+		if (layer > 0) {
+			fgets(buffer, 255, file);
+			fgets(buffer, 255, file);
+		}
+		for (u32 i = 0; i < size; ++i) {
+			i32 id;
+			if (fscanf(file, "%d", &id) != 1)
+				BMT_LOG(FATAL_ERROR, "[%s] Layer %d ends after %d of %d tiles", filename, layer + 1, i, size);
+			map.grid[layer][i] = id;
+		}
 	}
 
-	i32 size;
+	i32 count = 0;
 	fgets(buffer, 255, file);
 	fgets(buffer, 255, file);
-	fscanf(file, "%d", &size);
-	for (u16 i = 0; i < size; ++i) {
+	fscanf(file, "%d", &count);
+	for (u32 i = 0; i < (u32)count; ++i) {
+		i32 x, y, hp, maxHp, type, owner;
+		if (fscanf(file, "%d %d %d %d %d %d", &x, &y, &hp, &maxHp, &type, &owner) != 6)
+			BMT_LOG(FATAL_ERROR, "[%s] Unit %d of %d could not be read", filename, i + 1, count);
 		Unit unit = { 0 };
-		fscanf(file, "%d %d %d %d %d %d", &unit.pos.x, &unit.pos.y, &unit.hp, &unit.maxHp, &unit.type, &unit.owner);
+		unit.pos = { (f32)x, (f32)y };
+		unit.hp = (i16)hp;
+		unit.maxHp = (i16)maxHp;
+		unit.type = (UnitType)type;
+		unit.owner = (Owner)owner;
 		map.units.push_back(unit);
 	}
 
+	//the rest of the last unit line, then the #buildings header
+	fgets(buffer, 255, file);
+	fgets(buffer, 255, file);
+	count = 0;
+	fscanf(file, "%d", &count);
 	fgets(buffer, 255, file);
-	fscanf(file, "%d", &size);
-	for (u16 i = 0; i < size; ++i) {
+	for (u32 i = 0; i < (u32)count; ++i) {
 		Wall building = { 0 };
 		building.active = true;
 		i32 x;
 		i32 y;
-		fscanf(file, "%d %d %d %d %d", &x, &y, &building.hp);
+		//one wall per line as x y hp, older files pad the line with two more numbers
+		if (fgets(buffer, 255, file) == NULL || sscanf(buffer, "%d %d %d", &x, &y, &building.hp) != 3)
+			break;
+		//unused lines are padded out with zeros, which are not walls
+		if (building.hp <= 0)
+			continue;
+		if (x < 0 || y < 0 || x >= width || y >= height) {
+			BMT_LOG(WARNING, "[%s] Wall at %d, %d is outside the map", filename, x, y);
+			continue;
+		}
 		map.walls[x + y * map.width] = building;
 	}
 
@@ -845,43 +1421,299 @@ Map load_map(const char* filename) {
 	return map;
 }
 
+//writes the map in the format load_map reads, used by the editor and by map_gen
 static inline
-Wall* get_closest_wall(Map* map, Unit* unit, f32* distance, u16* xRef, u16* yRef, bool random = false) {
-	Wall* result = NULL;
-	f32 shortest = INT_MAX;
-
-	for (u16 x = 0; x < map->width; ++x) {
-		for (u16 y = 0; y < map->height; ++y) {
-			f32 dist = getDistanceE(x * TILE_SIZE, y * TILE_SIZE, unit->pos.x, unit->pos.y);
-			if (map->walls[x + y * map->width].active && shortest > dist) {
-				if (random && random_int(0, 100) < 50)
-					continue;
+void save_map(Map* map, const char* filename) {
+	FILE *file = fopen(filename, "w");
+	if (file == NULL)
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
+
+	u32 size = (u32)map->width * map->height;
+	fprintf(file, "#map\n");
+	fprintf(file, "#layer1\n");
+	fprintf(file, "%d\n", map->width);
+	fprintf(file, "%d\n", map->height);
+	for (u32 i = 0; i < size; ++i)
+		fprintf(file, "%d ", map->grid[0][i]);
+	fprintf(file, "\n");
+
+	fprintf(file, "#layer2\n");
+	for (u32 i = 0; i < size; ++i)
+		fprintf(file, "%d ", map->grid[1][i]);
+	fprintf(file, "\n");
+
+	fprintf(file, "#layer3\n");
+	for (u32 i = 0; i < size; ++i)
+		fprintf(file, "%d ", map->grid[2][i]);
+	fprintf(file, "\n");
+
+	fprintf(file, "#units\n");
+	fprintf(file, "%d\n", (i32)map->units.size());
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		Unit* curr = &map->units[i];
+		fprintf(file, "%d %d %d %d %d %d\n", (i32)curr->pos.x, (i32)curr->pos.y, curr->hp, curr->maxHp, (i32)curr->type, (i32)curr->owner);
+	}
 
-				shortest = dist;
-				result = &map->walls[x + y * map->width];
-				*xRef = x;
-				*yRef = y;
-			}
+	//load_map reads a count before the walls
+	u32 walls = 0;
+	for (u32 i = 0; i < size; ++i) {
+		if (map->walls[i].active)
+			walls++;
+	}
+	fprintf(file, "#buildings\n");
+	fprintf(file, "%d\n", walls);
+	for (u32 x = 0; x < map->width; ++x) {
+		for (u32 y = 0; y < map->height; ++y) {
+			Wall* curr = &map->walls[x + y * map->width];
+			if (curr->active)
+				fprintf(file, "%d %d %d\n", x, y, curr->hp);
 		}
 	}
 
-	*distance = shortest;
-	return result;
+	fclose(file);
 }
 
+//a scenario names a map file and sets up everything choose_map otherwise does in code:
+//	map data/file.txt
+//	money 3000
+//	time 2800                       ticks until the first wave
+//	gold x y coins
+//	turret x y type                 on top of a wall from the map's #buildings
+//	wave count type side ...        count boats, as add_wave takes them
 static inline
-Unit* get_closest_enemy(Map* map, vec2 origin, Owner targetFaction, f32* distance) {
-	Unit* result = NULL;
-	f32 shortest = INT_MAX;
+Game load_scenario(const char* filename) {
+	//a scenario converted by map_convert holds the map and everything else in one file
+	if (is_map_binary(filename))
+		return load_scenario_binary(filename);
 
-	for (u16 i = 0; i < map->units.size(); ++i) {
-		Unit* curr = &map->units[i];
+	Game game = { GAME_MENU };
 
-		if (curr->owner == targetFaction) {
-			f32 dist = getDistanceE(curr->pos.x, curr->pos.y, origin.x, origin.y);
-			if (shortest > dist) {
-				shortest = dist;
-				result = curr;
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
+
+	bool loadedMap = false;
+	char directive[255];
+	while (fscanf(file, "%254s", directive) == 1) {
+		//a # line is a comment
+		if (directive[0] == '#') {
+			char line[255];
+			fgets(line, 255, file);
+			continue;
+		}
+
+		if (strcmp(directive, "map") == 0) {
+			char mapfile[255];
+			fscanf(file, "%254s", mapfile);
+			game.map = load_map(mapfile);
+			loadedMap = true;
+		}
+		else if (strcmp(directive, "money") == 0) {
+			fscanf(file, "%u", &game.money);
+		}
+		else if (strcmp(directive, "time") == 0) {
+			fscanf(file, "%u", &game.nextWaveTime);
+		}
+		else if (!loadedMap) {
+			BMT_LOG(FATAL_ERROR, "[%s] '%s' comes before the map directive", filename, directive);
+		}
+		else if (strcmp(directive, "gold") == 0) {
+			i32 x, y, coins;
+			fscanf(file, "%d %d %d", &x, &y, &coins);
+			game.map.goldpiles.push_back({ (i16)x, (i16)y, (u8)coins });
+		}
+		else if (strcmp(directive, "turret") == 0) {
+			i32 x, y, type;
+			fscanf(file, "%d %d %d", &x, &y, &type);
+			Turret turret = { 0 };
+			turret.x = x;
+			turret.y = y;
+			turret.type = (TurretType)type;
+			turret.shotDelay = turret.type == TURRET_CANNON ? 140 : turret.type == TURRET_MAGE ? 300 : 105;
+			game.map.turrets.push_back(turret);
+		}
+		else if (strcmp(directive, "wave") == 0) {
+			u32 count;
+			fscanf(file, "%u", &count);
+			std::string params;
+			for (u32 i = 0; i < count; ++i) {
+				i32 type;
+				char side[8];
+				fscanf(file, "%d %7s", &type, side);
+				params += std::to_string(type);
+				params += ' ';
+				params += side;
+				params += ' ';
+			}
+			add_wave(&game, params.c_str());
+		}
+		else {
+			BMT_LOG(WARNING, "[%s] Unknown directive '%s'", filename, directive);
+		}
+	}
+	fclose(file);
+
+	if (!loadedMap)
+		BMT_LOG(FATAL_ERROR, "[%s] Scenario has no map", filename);
+
+	orient_walls(&game.map);
+	return game;
+}
+
+//appends a section, LZ4 compressed when asked for and it comes out smaller
+static inline
+void push_map_section(std::vector<MapFileSection>* sections, std::vector<std::vector<u8>>* blobs, MapSectionType type, const void* data, u64 size, bool compress) {
+	MapFileSection section = { 0 };
+	section.type = type;
+	section.size = size;
+	section.rawSize = size;
+
+	std::vector<u8> blob((const u8*)data, (const u8*)data + size);
+#if defined(BMT_USE_LZ4)
+	if (compress && size > 0) {
+		std::vector<u8> packed(LZ4_compressBound((i32)size));
+		i32 packedSize = LZ4_compress_default((const char*)data, (char*)packed.data(), (i32)size, (i32)packed.size());
+		if (packedSize > 0 && (u64)packedSize < size) {
+			packed.resize(packedSize);
+			blob.swap(packed);
+			section.compression = MAP_COMPRESSION_LZ4;
+			section.size = packedSize;
+		}
+	}
+#else
+	if (compress)
+		BMT_LOG(WARNING, "Built without BMT_USE_LZ4, writing the map uncompressed");
+#endif
+	sections->push_back(section);
+	blobs->push_back(blob);
+}
+
+//writes the map in the binary format, along with the waves, money and wave timer when a
+//game is given, so one file holds a whole scenario
+static inline
+void save_map_binary(Map* map, const char* filename, Game* game = NULL, bool compress = false) {
+	std::vector<MapFileSection> sections;
+	std::vector<std::vector<u8>> blobs;
+	u32 size = map->width * map->height;
+
+	//the layers aren't necessarily one block, a mapped map's are but create_map's follow the walls
+	std::vector<i16> layers(size * NUM_LAYERS);
+	for (u32 i = 0; i < NUM_LAYERS; ++i)
+		memcpy(&layers[i * size], map->grid[i], size * sizeof(i16));
+	push_map_section(&sections, &blobs, MAP_SECTION_LAYERS, layers.data(), layers.size() * sizeof(i16), compress);
+
+	std::vector<MapFileWall> walls;
+	for (u32 i = 0; i < size; ++i) {
+		Wall* wall = &map->walls[i];
+		if (wall->active)
+			walls.push_back({ (i32)(i % map->width), (i32)(i / map->width), wall->hp, wall->gate });
+	}
+	push_map_section(&sections, &blobs, MAP_SECTION_WALLS, walls.data(), walls.size() * sizeof(MapFileWall), compress);
+
+	std::vector<MapFileUnit> units;
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		Unit* unit = &map->units[i];
+		units.push_back({ unit->pos.x, unit->pos.y, unit->hp, unit->maxHp, unit->type, unit->owner });
+	}
+	push_map_section(&sections, &blobs, MAP_SECTION_UNITS, units.data(), units.size() * sizeof(MapFileUnit), compress);
+
+	std::vector<MapFileGoldPile> piles;
+	for (u32 i = 0; i < map->goldpiles.size(); ++i)
+		piles.push_back({ map->goldpiles[i].x, map->goldpiles[i].y, map->goldpiles[i].coins });
+	push_map_section(&sections, &blobs, MAP_SECTION_GOLDPILES, piles.data(), piles.size() * sizeof(MapFileGoldPile), compress);
+
+	std::vector<MapFileTurret> turrets;
+	for (u32 i = 0; i < map->turrets.size(); ++i) {
+		Turret* turret = &map->turrets[i];
+		turrets.push_back({ turret->x, turret->y, turret->type, turret->shotDelay });
+	}
+	push_map_section(&sections, &blobs, MAP_SECTION_TURRETS, turrets.data(), turrets.size() * sizeof(MapFileTurret), compress);
+
+	if (game != NULL) {
+		std::vector<u8> waves;
+		u32 numWaves = game->waves.size();
+		waves.insert(waves.end(), (u8*)&numWaves, (u8*)&numWaves + sizeof(u32));
+		for (u32 w = 0; w < numWaves; ++w) {
+			u32 count = game->waves[w].size();
+			waves.insert(waves.end(), (u8*)&count, (u8*)&count + sizeof(u32));
+			for (u32 i = 0; i < count; ++i) {
+				MapFileBoat boat = { game->waves[w][i].unit.type, game->waves[w][i].side };
+				waves.insert(waves.end(), (u8*)&boat, (u8*)&boat + sizeof(MapFileBoat));
+			}
+		}
+		push_map_section(&sections, &blobs, MAP_SECTION_WAVES, waves.data(), waves.size(), compress);
+	}
+
+	MapFileHeader header = { 0 };
+	memcpy(header.magic, MAP_FILE_MAGIC, 4);
+	header.version = MAP_FILE_VERSION;
+	header.width = map->width;
+	header.height = map->height;
+	header.money = game != NULL ? game->money : 0;
+	header.nextWaveTime = game != NULL ? game->nextWaveTime : 0;
+	header.numSections = sections.size();
+
+	u64 offset = sizeof(MapFileHeader) + sections.size() * sizeof(MapFileSection);
+	for (u32 i = 0; i < sections.size(); ++i) {
+		offset = (offset + MAP_FILE_ALIGN - 1) & ~(u64)(MAP_FILE_ALIGN - 1);
+		sections[i].offset = offset;
+		offset += sections[i].size;
+	}
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		BMT_LOG(FATAL_ERROR, "[%s] Error opening file", filename);
+
+	LOCAL const u8 PADDING[MAP_FILE_ALIGN] = { 0 };
+	fwrite(&header, sizeof(MapFileHeader), 1, file);
+	fwrite(sections.data(), sizeof(MapFileSection), sections.size(), file);
+	u64 written = sizeof(MapFileHeader) + sections.size() * sizeof(MapFileSection);
+	for (u32 i = 0; i < sections.size(); ++i) {
+		fwrite(PADDING, 1, sections[i].offset - written, file);
+		fwrite(blobs[i].data(), 1, blobs[i].size(), file);
+		written = sections[i].offset + sections[i].size;
+	}
+
+	fclose(file);
+}
+
+static inline
+Wall* get_closest_wall(Map* map, Unit* unit, f32* distance, u32* xRef, u32* yRef, bool random = false) {
+	Wall* result = NULL;
+	f32 shortest = INT_MAX;
+
+	for (u32 x = 0; x < map->width; ++x) {
+		for (u32 y = 0; y < map->height; ++y) {
+			f32 dist = getDistanceE(x * TILE_SIZE, y * TILE_SIZE, unit->pos.x, unit->pos.y);
+			if (map->walls[x + y * map->width].active && shortest > dist) {
+				if (random && random_int(0, 100) < 50)
+					continue;
+
+				shortest = dist;
+				result = &map->walls[x + y * map->width];
+				*xRef = x;
+				*yRef = y;
+			}
+		}
+	}
+
+	*distance = shortest;
+	return result;
+}
+
+static inline
+Unit* get_closest_enemy(Map* map, vec2 origin, Owner targetFaction, f32* distance) {
+	Unit* result = NULL;
+	f32 shortest = INT_MAX;
+
+	for (u16 i = 0; i < map->units.size(); ++i) {
+		Unit* curr = &map->units[i];
+
+		if (curr->owner == targetFaction) {
+			f32 dist = getDistanceE(curr->pos.x, curr->pos.y, origin.x, origin.y);
+			if (shortest > dist) {
+				shortest = dist;
+				result = curr;
 			}
 		}
 	}
@@ -916,8 +1748,8 @@ vec2 get_closest_land(Map* map, vec2 origin) {
 	vec2 result = { 0, 0 };
 	f32 shortest = INT_MAX;
 
-	for (u16 x = 0; x < map->width; ++x) {
-		for (u16 y = 0; y < map->height; ++y) {
+	for (u32 x = 0; x < map->width; ++x) {
+		for (u32 y = 0; y < map->height; ++y) {
 			f32 dist = getDistanceE(x * TILE_SIZE, y * TILE_SIZE, origin.x, origin.y);
 			if (map->grid[0][x + y * map->width] != 72 && shortest > dist) {
 				if (random_int(0, 100) < 50)
@@ -942,9 +1774,7 @@ bool goldpile_depleted(Map* map) {
 }
 
 static inline
-void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState* mainstate, bool demo = false) {
-	draw_map(batch, &game->map, scene);
-
+void spawn_wave(Game* game) {
 	//new wave spawns
 	if (game->timer == game->nextWaveTime) {
 		if (game->currentWave < game->waves.size()) {
@@ -957,11 +1787,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 
 				Side side = game->waves.at(game->currentWave).at(i).side;
 				Unit boat = game->waves.at(game->currentWave).at(i).unit;
-				if (boat.type == UNIT_GOLIATH_SHIP)
-					push_notification(game, "That ship... the Goliath comes.");
-
-				if (boat.type == UNIT_EDRIC_SHIP)
-					push_notification(game, "That ship... Edric the Swashbuckling Sorcerer comes.");
+				const char* notification = get_archetype(boat.type)->notification;
+				if (notification != NULL)
+					push_notification(game, notification);
 
 				if (game->currentWave == game->waves.size() - 1) {
 					push_notification(game, "They will put everything they have on this last attack!");
@@ -986,7 +1814,10 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->currentWave++;
 		}
 	}
+}
 
+static inline
+void update_turrets(Game* game, MapScene* scene) {
 	//update cannons target and shoot on interval
 	for (u16 i = 0; i < game->map.turrets.size(); ++i) {
 		f32 dist = 0;
@@ -995,12 +1826,6 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		Unit* target = get_closest_enemy(&game->map, { (f32)turret->x * TILE_SIZE, (f32)turret->y * TILE_SIZE }, OWNER_INVADERS, &dist);
 		turret->timer++;
 
-		if (turret->type == TURRET_CANNON)
-			draw_texture_rotated(batch, scene->cannon, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y, turret->rotation);
-		if (turret->type == TURRET_MAGE)
-			draw_texture(batch, scene->mage, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y);
-		if(turret->type == TURRET_STONETHROWER)
-			draw_texture(batch, scene->stonethrower, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y);
 
 		if (turret->timer % turret->shotDelay == 0 && target != NULL && dist < CANNON_RANGE) {
 			turret->rotation = get_angle({ (f32)turret->x * TILE_SIZE, (f32)turret->y * TILE_SIZE }, { target->pos.x + (random_int(6, scene->attackerMage.width) - 10), target->pos.y + random_int(6, (scene->attackerMage.height) - 10) });
@@ -1028,99 +1853,317 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->map.projectiles.push_back(ball);
 		}
 	}
+}
 
-	//calculate unit velocity and steering vectors
-	for (u16 i = 0; i < game->map.units.size(); ++i) {
-		Unit* unit = &game->map.units[i];
-
-		if (unit->hp <= 0) {
-			play_sound(scene->coin[random_int(0, 2)]);
+//what get_closest_wall and get_closest_goldpile found for a tile
+struct RetargetResult {
+	i32 tileX;
+	i32 tileY;
+	Wall* wtarget;
+	GoldPile* gtarget;
+	u32 wallx;
+	u32 wally;
+	f32 walldist;
+	f32 golddist;
+};
 
-			if (unit->type == UNIT_GOLIATH) {
-				push_status_text(game, unit->pos, "+360 gold");
-				game->money += 360;
-			}
-			if (unit->type == UNIT_EDRIC) {
-				push_status_text(game, unit->pos, "+320 gold");
-				game->money += 320;
-			}
-			else {
-				push_status_text(game, unit->pos, format_text("+%d gold", GOLD_BOUNTY));
-				game->money += GOLD_BOUNTY;
+//sends an idle invader after the wall or gold pile that was found for it
+static inline
+void retarget_unit(Unit* unit, RetargetResult* result) {
+	f32 walldist = result->walldist;
+	f32 golddist = result->golddist;
+	u32 wallx = result->wallx;
+	u32 wally = result->wally;
+	unit->wtarget = result->wtarget;
+	unit->gtarget = result->gtarget;
+
+	if (golddist > 0 && golddist < walldist) {
+		unit->dest = { (f32)unit->gtarget->x * TILE_SIZE, (f32)unit->gtarget->y * TILE_SIZE };
+		unit->state = UNIT_WALKING;
+	}
+	else
+		unit->gtarget = NULL;
+
+	const UnitArchetype* archetype = get_archetype(unit->type);
+	if (wallx >= 0 && wally >= 0 && (walldist <= golddist || (archetype->flags & ARCHETYPE_SIEGE))) {
+		if (archetype->flags & ARCHETYPE_BOULDER) {
+			unit->dest = { (f32)(wallx * TILE_SIZE), (f32)(wally * TILE_SIZE) };
+
+			if (getDistanceE(unit->pos.x, unit->pos.y, unit->dest.x, unit->dest.y) > 250)
+				unit->origin = { -1, -1 };
+
+			unit->state = UNIT_WALKING;
+		}
+		else if (archetype->flags & ARCHETYPE_RANGED) {
+			f32 angle = get_angle({ (f32)(wallx * TILE_SIZE), (f32)wally * TILE_SIZE }, unit->pos);
+			vec2 dest = {
+				(wallx * TILE_SIZE) + cos(deg_to_rad(angle)) * archetype->range,
+				(wally * TILE_SIZE) + sin(deg_to_rad(angle)) * archetype->range
+			};
+
+			unit->state = UNIT_WALKING;
+			unit->dest = dest;
+			if (getDistanceE(unit->pos.x, unit->pos.y, (wallx * TILE_SIZE), (wally * TILE_SIZE)) < archetype->range) {
+				BMT_LOG(DEBUG, "%f < %f", getDistanceE(unit->pos.x, unit->pos.y, (wallx * TILE_SIZE), (wally * TILE_SIZE)), archetype->range);
+				unit->dest = unit->pos;
+				unit->state = UNIT_RANGING;
 			}
+			unit->origin = { (f32)(wallx * TILE_SIZE), (f32)wally * TILE_SIZE };
+		}
+		else {
+			//unit->utarget = utarget;
+			unit->dest = { (f32)wallx * TILE_SIZE, (f32)wally * TILE_SIZE };
+			unit->state = UNIT_WALKING;
+		}
+	}
+	else
+		unit->wtarget = NULL;
+}
 
-			game->map.units.erase(game->map.units.begin() + i);
-			continue;
+#define SQUAD_PLAN_TICKS	120		//how long members keep following a plan before searching again
+
+static inline
+u16 create_squad(Map* map, vec2 origin, u32 members) {
+	Squad squad = { 0 };
+	squad.origin = origin;
+	squad.members = members;
+	squad.wall = -1;
+	squad.goldpile = -1;
+
+	for (u32 i = 0; i < map->squads.size(); ++i) {
+		if (map->squads[i].members == 0) {
+			map->squads[i] = squad;
+			return i + 1;
 		}
+	}
+	map->squads.push_back(squad);
+	return map->squads.size();
+}
 
-		if (unit->type == UNIT_ULTIMATE_BOSS || unit->type == UNIT_GOLIATH || unit->type == UNIT_EDRIC) {
-			const char* name = unit->type == UNIT_GOLIATH ? "GOLIATH" : unit->type == UNIT_EDRIC ? "Edric the Swashbuckling Sorcerer" : "???";
-			draw_text(batch, &scene->font, name, (get_window_width() / 2) - (get_string_width(&scene->font, name) / 2), get_window_height() - 55);
+//frees the squads whose members have all died or gone home
+static inline
+void update_squads(Map* map) {
+	for (u32 i = 0; i < map->squads.size(); ++i)
+		map->squads[i].members = 0;
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		if (map->units[i].squad != 0)
+			map->squads[map->units[i].squad - 1].members++;
+	}
+}
 
-			f32 width = ((f32)((f32)unit->hp / (f32)unit->maxHp) * get_window_width());
-			i32 xPos = (get_window_width() / 2) - ((scene->barleft.width + width) / 2);
-			draw_texture(batch, scene->barleft, xPos, get_window_height() - 20);
-			draw_texture_EX(batch, scene->barmid, { 0, 0, (f32)scene->barmid.width, (f32)scene->barmid.height }, { (f32)(xPos += scene->barleft.width), (f32)(get_window_height() - 20), width, (f32)scene->barmid.height });
-			draw_texture(batch, scene->barright, xPos += width, get_window_height() - 20);
+static inline
+bool squad_plan_fresh(Game* game, Squad* squad) {
+	if (!squad->planned || game->tick - squad->plannedTick >= SQUAD_PLAN_TICKS)
+		return false;
+	return squad->wall < 0 || game->map.walls[squad->wall].active;
+}
+
+//spots in a sunflower spiral around the squad's target, one unit apart
+static inline
+vec2 formation_offset(u16 slot) {
+	f32 angle = slot * 2.39996f;
+	f32 radius = MIN_SEPERATION * sqrtf(slot);
+	return { cosf(angle) * radius, sinf(angle) * radius };
+}
+
+//Idle invaders look for something to attack here rather than in update_units. A boat
+//unloading or a wall going down idles a crowd of units on the same tick, and every search
+//scans the whole map, so searching is capped at RETARGET_BUDGET tiles a tick and the rest
+//wait their turn, starting with them next tick. Units standing on the same tile (a boat's
+//worth of invaders, or the ones that were hitting the same wall) share one search.
+#define RETARGET_BUDGET		(1 << 17)
+#define RETARGET_CACHE_SIZE	32
+
+static inline
+void update_retargeting(Game* game) {
+	u32 numUnits = game->map.units.size();
+	if (numUnits == 0)
+		return;
+
+	RetargetResult cache[RETARGET_CACHE_SIZE];
+	u32 numSearches = 0;
+	i64 budget = RETARGET_BUDGET;
+	i64 searchCost = (i64)game->map.width * game->map.height + game->map.goldpiles.size();
+
+	u32 start = game->retargetCursor < numUnits ? game->retargetCursor : 0;
+	for (u32 n = 0; n < numUnits; ++n) {
+		u32 index = (start + n) % numUnits;
+		Unit* unit = &game->map.units[index];
+		if (unit->owner != OWNER_INVADERS || unit->state != UNIT_IDLE || unit->hp <= 0)
+			continue;
+
+		Squad* squad = unit->squad != 0 ? &game->map.squads[unit->squad - 1] : NULL;
+		if (squad != NULL && squad_plan_fresh(game, squad)) {
+			RetargetResult plan = { 0 };
+			plan.wtarget = squad->wall >= 0 ? &game->map.walls[squad->wall] : NULL;
+			plan.gtarget = squad->goldpile >= 0 ? &game->map.goldpiles[squad->goldpile] : NULL;
+			plan.wallx = squad->wallx;
+			plan.wally = squad->wally;
+			plan.walldist = squad->walldist;
+			plan.golddist = squad->golddist;
+			retarget_unit(unit, &plan);
+			if (unit->state == UNIT_WALKING && !has_flag(unit->type, ARCHETYPE_RANGED))
+				unit->dest = unit->dest + formation_offset(unit->squadSlot);
+			continue;
 		}
 
-		if (unit->owner == OWNER_INVADERS && unit->state == UNIT_IDLE) {
-			f32 walldist = 0;
-			f32 golddist = 0;
-			u16 wallx = -1;
-			u16 wally = -1;
-			GoldPile* gtarget = get_closest_goldpile(&game->map, unit, &golddist);
-			Wall* wtarget = get_closest_wall(&game->map, unit, &walldist, &wallx, &wally);
-			unit->wtarget = wtarget;
-			unit->gtarget = gtarget;
+		i32 tileX = (i32)floor(unit->pos.x / TILE_SIZE);
+		i32 tileY = (i32)floor(unit->pos.y / TILE_SIZE);
+		RetargetResult* result = NULL;
+		for (u32 i = 0; i < std::min(numSearches, (u32)RETARGET_CACHE_SIZE); ++i) {
+			if (cache[i].tileX == tileX && cache[i].tileY == tileY) {
+				result = &cache[i];
+				break;
+			}
+		}
 
-			if (golddist > 0 && golddist < walldist) {
-				unit->dest = { (f32)unit->gtarget->x * TILE_SIZE, (f32)unit->gtarget->y * TILE_SIZE };
-				unit->state = UNIT_WALKING;
+		if (result == NULL) {
+			if (budget <= 0) {
+				game->retargetCursor = index;
+				return;
 			}
-			else
-				unit->gtarget = NULL;
+			budget -= searchCost;
+
+			result = &cache[numSearches++ % RETARGET_CACHE_SIZE];
+			result->tileX = tileX;
+			result->tileY = tileY;
+			result->walldist = 0;
+			result->golddist = 0;
+			result->wallx = -1;
+			result->wally = -1;
+			result->gtarget = get_closest_goldpile(&game->map, unit, &result->golddist);
+			result->wtarget = get_closest_wall(&game->map, unit, &result->walldist, &result->wallx, &result->wally);
+		}
+
+		if (squad != NULL) {
+			squad->planned = true;
+			squad->plannedTick = game->tick;
+			squad->wall = result->wtarget != NULL ? (i32)(result->wtarget - game->map.walls) : -1;
+			squad->goldpile = result->gtarget != NULL ? (i32)(result->gtarget - game->map.goldpiles.data()) : -1;
+			squad->wallx = result->wallx;
+			squad->wally = result->wally;
+			squad->walldist = result->walldist;
+			squad->golddist = result->golddist;
+		}
+
+		retarget_unit(unit, result);
+		if (squad != NULL && unit->state == UNIT_WALKING && !has_flag(unit->type, ARCHETYPE_RANGED))
+			unit->dest = unit->dest + formation_offset(unit->squadSlot);
+	}
+	game->retargetCursor = 0;
+}
 
-			if (wallx >= 0 && wally >= 0 && (walldist <= golddist || unit->type == UNIT_GOLIATH || unit->type == UNIT_MAGE || unit->type == UNIT_STONETHROWER || unit->type == UNIT_EDRIC)) {
-				if (unit->type == UNIT_GOLIATH) {
-					unit->dest = { (f32)(wallx * TILE_SIZE), (f32)(wally * TILE_SIZE) };
+//Units far from the fort and out of view run at reduced fidelity: they steer every
+//LOD_INTERVAL ticks rather than every tick, straight at their destination with only walls
+//pushing them. Within LOD_MARGIN of the view, of a turret's range or of a gold pile they
+//are back at full fidelity. The view is a fixed LOD_VIEW_WIDTH x LOD_VIEW_HEIGHT box at the
+//camera rather than the window, so a game (and its replay) does not depend on window size.
+#define LOD_INTERVAL		4
+#define LOD_CELL_TILES		4
+#define LOD_VIEW_WIDTH		1920
+#define LOD_VIEW_HEIGHT		1080
 
-					if (getDistanceE(unit->pos.x, unit->pos.y, unit->dest.x, unit->dest.y) > 250)
-						unit->origin = { -1, -1 };
+const f32 LOD_MARGIN = 256;
 
-					unit->state = UNIT_WALKING;
-				}
-				else if (unit->type == UNIT_MAGE || unit->type == UNIT_STONETHROWER || unit->type == UNIT_EDRIC) {
-					f32 angle = get_angle({ (f32)(wallx * TILE_SIZE), (f32)wally * TILE_SIZE }, unit->pos);
-					vec2 dest = {
-						(wallx * TILE_SIZE) + cos(deg_to_rad(angle)) * (unit->type == UNIT_MAGE ? MAGE_RANGE : STONETHROWER_RANGE),
-						(wally * TILE_SIZE) + sin(deg_to_rad(angle)) * (unit->type == UNIT_MAGE ? MAGE_RANGE : STONETHROWER_RANGE)
-					};
+//sim_bench turns this off to check reduced fidelity plays out the same
+GLOBAL bool unitLOD = true;
 
-					unit->state = UNIT_WALKING;
-					unit->dest = dest;
-					if (getDistanceE(unit->pos.x, unit->pos.y, (wallx * TILE_SIZE), (wally * TILE_SIZE)) < (unit->type == UNIT_MAGE ? MAGE_RANGE : STONETHROWER_RANGE)) {
-						BMT_LOG(DEBUG, "%f < %f", getDistanceE(unit->pos.x, unit->pos.y, (wallx * TILE_SIZE), (wally * TILE_SIZE)), (unit->type == UNIT_MAGE ? MAGE_RANGE : STONETHROWER_RANGE));
-						unit->dest = unit->pos;
-						unit->state = UNIT_RANGING;
-					}
-					unit->origin = { (f32)(wallx * TILE_SIZE), (f32)wally * TILE_SIZE };
-				}
-				else {
-					//unit->utarget = utarget;
-					unit->dest = { (f32)wallx * TILE_SIZE, (f32)wally * TILE_SIZE };
-					unit->state = UNIT_WALKING;
-				}
-			}
-			else
-				unit->wtarget = NULL;
+#define STEERING_GRAIN		64 //units per steering job
+
+static inline
+void mark_focus(Map* map, u32 cellsX, u32 cellsY, f32 x, f32 y) {
+	const f32 cellSize = LOD_CELL_TILES * TILE_SIZE;
+	const f32 radius = CANNON_RANGE + LOD_MARGIN + cellSize;
+	i32 x0 = std::max(0, (i32)floorf((x - radius) / cellSize));
+	i32 y0 = std::max(0, (i32)floorf((y - radius) / cellSize));
+	i32 x1 = std::min((i32)cellsX - 1, (i32)floorf((x + radius) / cellSize));
+	i32 y1 = std::min((i32)cellsY - 1, (i32)floorf((y + radius) / cellSize));
+	for (i32 cy = y0; cy <= y1; ++cy) {
+		for (i32 cx = x0; cx <= x1; ++cx)
+			map->focus[cx + cy * cellsX] = 1;
+	}
+}
+
+//marks the cells of LOD_CELL_TILES x LOD_CELL_TILES tiles close enough to a turret or gold
+//pile that units in them need full fidelity
+static inline
+void update_focus(Map* map) {
+	u32 cellsX = (map->width + LOD_CELL_TILES - 1) / LOD_CELL_TILES;
+	u32 cellsY = (map->height + LOD_CELL_TILES - 1) / LOD_CELL_TILES;
+	map->focus.assign(cellsX * cellsY, 0);
+
+	for (u32 i = 0; i < map->turrets.size(); ++i)
+		mark_focus(map, cellsX, cellsY, map->turrets[i].x * TILE_SIZE, map->turrets[i].y * TILE_SIZE);
+	for (u32 i = 0; i < map->goldpiles.size(); ++i)
+		mark_focus(map, cellsX, cellsY, map->goldpiles[i].x * TILE_SIZE, map->goldpiles[i].y * TILE_SIZE);
+}
+
+static inline
+bool in_focus(Map* map, Unit* unit) {
+	if (unit->pos.x > -map->x - LOD_MARGIN && unit->pos.x < -map->x + LOD_VIEW_WIDTH + LOD_MARGIN &&
+		unit->pos.y > -map->y - LOD_MARGIN && unit->pos.y < -map->y + LOD_VIEW_HEIGHT + LOD_MARGIN)
+		return true;
+
+	i32 cellX = (i32)floorf(unit->pos.x / (LOD_CELL_TILES * TILE_SIZE));
+	i32 cellY = (i32)floorf(unit->pos.y / (LOD_CELL_TILES * TILE_SIZE));
+	u32 cellsX = (map->width + LOD_CELL_TILES - 1) / LOD_CELL_TILES;
+	u32 cellsY = (map->height + LOD_CELL_TILES - 1) / LOD_CELL_TILES;
+	if (cellX < 0 || cellY < 0 || (u32)cellX >= cellsX || (u32)cellY >= cellsY)
+		return false;
+	return map->focus[cellX + cellY * cellsX] != 0;
+}
+
+//a steering job: seek plus seperation for the units in [begin, end). It only reads the map
+//and writes each unit's own forceToApply, so the jobs can run at the same time
+static inline
+void steer_units(void* data, u32 begin, u32 end) {
+	Game* game = (Game*)data;
+	for (u32 i = begin; i < end; ++i) {
+		Unit* unit = &game->map.units[i];
+		if (unit->dest.x < 0 || unit->dest.y < 0)
+			continue;
+
+		//reduced fidelity units take turns steering, keeping their last force in between
+		bool full = !unitLOD || in_focus(&game->map, unit);
+		if (full || (i + game->tick) % LOD_INTERVAL == 0) {
+			vec2 seek = calculate_seek(unit->dest, unit);
+			vec2 seperation = calculate_seperation(&game->map, i, full);
+			unit->forceToApply = seek + seperation;
+		}
+	}
+}
+
+static inline
+void update_units(Game* game, MapScene* scene) {
+	if (unitLOD)
+		update_focus(&game->map);
+
+	//deaths, melee and ranged attacks play sounds, draw random numbers and change the map, so
+	//they stay on this thread
+	for (u16 i = 0; i < game->map.units.size(); ++i) {
+		Unit* unit = &game->map.units[i];
+
+		if (unit->hp <= 0) {
+			play_sound(scene->coin[random_int(0, 2)]);
+
+			u32 bounty = get_archetype(unit->type)->bounty;
+			push_status_text(game, unit->pos, format_text("+%d gold", bounty));
+			game->money += bounty;
+
+			game->map.units.erase(game->map.units.begin() + i);
+			continue;
 		}
+
 		if (unit->owner == OWNER_INVADERS && unit->state == UNIT_ATTACKING) {
 			if (unit->wtarget != NULL) {
 				unit->rotation += 0.5;
 				if ((i32)unit->rotation % 10 == 0) {
 					play_sound(scene->swing[random_int(0, 2)]);
 					unit->wtarget->hp -= unit->damage;
+					if (unit->wtarget->hp <= 0) {
+						u32 index = unit->wtarget - game->map.walls;
+						destroy_wall(&game->map, scene, index % game->map.width, index / game->map.width);
+					}
 				}
 			}
 			else if (unit->gtarget != NULL) {
@@ -1129,15 +2172,16 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 					unit->state = UNIT_RETREATING;
 					push_status_text(game, { unit->pos.x, unit->pos.y + 10 }, format_text("%d coins left", unit->gtarget->coins));
 					push_notification(game, "A coin has been stolen!");
-					unit->dest = unit->origin;
+					unit->dest = unit->squad != 0 ? game->map.squads[unit->squad - 1].origin : unit->origin;
 				}
 			}
 		}
 		if (unit->owner == OWNER_INVADERS && unit->state == UNIT_RANGING) {
-			unit->rotation += unit->type == UNIT_STONETHROWER ? 0.17 : 0.098;
+			const UnitArchetype* archetype = get_archetype(unit->type);
+			unit->rotation += archetype->throwSpeed;
 
-			if (unit->type == UNIT_EDRIC && (i32)unit->rotation == 16) {
-				u16 wall1x, wall1y, wall2x, wall2y;
+			if ((archetype->flags & ARCHETYPE_VOLLEY) && (i32)unit->rotation == 16) {
+				u32 wall1x, wall1y, wall2x, wall2y;
 				f32 wall1dist, wall2dist;
 				Wall* wtarget1 = get_closest_wall(&game->map, unit, &wall1dist, &wall1x, &wall1y, true);
 				Wall* wtarget2 = get_closest_wall(&game->map, unit, &wall2dist, &wall2x, &wall2y, true);
@@ -1168,23 +2212,24 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 				ball.x = unit->pos.x + (scene->attackerMage.width / 2) - (18 / 2);
 				ball.y = unit->pos.y + (scene->attackerMage.height / 2) - (39 / 2);
 
-				if (unit->type == UNIT_MAGE) {
-					ball.type = PROJECTILE_FIREBALL;
+				ball.type = archetype->projectile;
+				if (ball.type == PROJECTILE_FIREBALL)
 					ball.animation = create_animation("fire", scene->fire, 2, 18, 39, 6);
-				}
-				else if (unit->type == UNIT_STONETHROWER) {
-					ball.type = PROJECTILE_STONE;
-				}
 				game->map.projectiles.push_back(ball);
 			}
 		}
-
-		if (unit->dest.x >= 0 && unit->dest.y >= 0) {
-			vec2 seek = calculate_seek(unit->dest, unit);
-			vec2 seperation = calculate_seperation(&game->map.units, &game->map, unit);
-			unit->forceToApply = seek + seperation;
-		}
 	}
+
+	//then every unit steers from the same snapshot of positions, spread across the job workers
+	u32 numUnits = game->map.units.size();
+	game->map.positions.resize(numUnits);
+	for (u32 i = 0; i < numUnits; ++i)
+		game->map.positions[i] = game->map.units[i].pos;
+	parallel_for(numUnits, STEERING_GRAIN, steer_units, game);
+}
+
+static inline
+void integrate_units(Game* game, MapScene* scene) {
 	//apply vectors to unit position and check if it reached its destination
 	for (u16 i = 0; i < game->map.units.size(); ++i) {
 		Unit* unit = &game->map.units.at(i);
@@ -1192,7 +2237,7 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		unit->velocity = unit->velocity + (SCALING_FACTOR * unit->forceToApply);
 		truncate(&unit->velocity, MAX_SPEED);
 
-		if (unit->type == UNIT_ELITE_SHIP || unit->type == UNIT_DINGHY || unit->type == UNIT_RUSH_SHIP || unit->type == UNIT_GOLIATH_SHIP || unit->type == UNIT_EDRIC_SHIP || unit->type == UNIT_STONETHROWER_SHIP || unit->type == UNIT_MAGE_SHIP || unit->type == UNIT_ULTIMATE_BOSS_SHIP)
+		if (has_flag(unit->type, ARCHETYPE_SHIP))
 			unit->rotation = atan2(unit->velocity.y, unit->velocity.x) * (180 / 3.14159) - 90;
 		unit->pos = unit->pos + unit->velocity;
 
@@ -1201,7 +2246,7 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			unit->rotation = 0;
 		}
 
-		if (unit->type == UNIT_GOLIATH && unit->origin.x == -1 && unit->origin.y == -1 && getDistanceE(unit->pos.x, unit->pos.y, unit->dest.x, unit->dest.y) < GOLIATH_RANGE) {
+		if (has_flag(unit->type, ARCHETYPE_BOULDER) && unit->origin.x == -1 && unit->origin.y == -1 && getDistanceE(unit->pos.x, unit->pos.y, unit->dest.x, unit->dest.y) < GOLIATH_RANGE) {
 			Projectile ball = { 0 };
 			play_sound(scene->goliathGrowl);
 			ball.owner = OWNER_INVADERS;
@@ -1213,8 +2258,11 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			unit->origin = { 0, 0 };
 		}
 
-		u32 index = (unit->pos.x / TILE_SIZE) + (unit->pos.y / TILE_SIZE) * game->map.width;
-		if (unit->state == UNIT_RETREATING && game->map.grid[0][index] == 72) {
+		//boats spawn just off the edge, so a unit retreating to its boat can be off the map
+		i32 tileX = (i32)floor(unit->pos.x / TILE_SIZE);
+		i32 tileY = (i32)floor(unit->pos.y / TILE_SIZE);
+		bool onMap = tileX >= 0 && tileY >= 0 && (u32)tileX < game->map.width && (u32)tileY < game->map.height;
+		if (unit->state == UNIT_RETREATING && onMap && game->map.grid[0][tileX + tileY * game->map.width] == 72) {
 			unit->type = UNIT_DINGHY;
 		}
 
@@ -1227,110 +2275,50 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			unit->forceToApply = { 0, 0 };
 
 			if (unit->owner == OWNER_INVADERS) {
-				if (unit->state == UNIT_WALKING && (unit->type == UNIT_FOOTSOLDIER || unit->type == UNIT_ELITE || unit->type == UNIT_ULTIMATE_BOSS)) {
+				const UnitArchetype* archetype = get_archetype(unit->type);
+				if (unit->state == UNIT_WALKING && (archetype->flags & ARCHETYPE_MELEE)) {
 					unit->state = UNIT_ATTACKING;
 				}
-				if (unit->state == UNIT_WALKING && (unit->type == UNIT_EDRIC || unit->type == UNIT_MAGE || unit->type == UNIT_STONETHROWER)) {
+				if (unit->state == UNIT_WALKING && (archetype->flags & ARCHETYPE_RANGED)) {
 					unit->state = UNIT_RANGING;
 				}
-				if (unit->state == UNIT_WALKING && (unit->type == UNIT_GOLIATH)) {
-					unit->state = UNIT_ATTACKING;
-				}
-				if (unit->type == UNIT_ELITE_SHIP || unit->type == UNIT_DINGHY || unit->type == UNIT_RUSH_SHIP || unit->type == UNIT_EDRIC_SHIP || unit->type == UNIT_STONETHROWER_SHIP || unit->type == UNIT_GOLIATH_SHIP || unit->type == UNIT_MAGE_SHIP || unit->type == UNIT_ULTIMATE_BOSS_SHIP) {
+				if (archetype->flags & ARCHETYPE_SHIP) {
 					if (getDistanceE(unit->pos.x, unit->pos.y, unit->origin.x, unit->origin.y) < 95) {
 						game->map.units.erase(game->map.units.begin() + i);
 						break;
 					}
-					//spawn invaders
-					Unit invader = { 0 };
-					invader.type = UNIT_FOOTSOLDIER;
-					invader.state = UNIT_IDLE;
-					invader.owner = OWNER_INVADERS;
-					invader.hp = 4;
-					invader.damage = 2;
-					invader.origin = unit->origin;
-					if (unit->type == UNIT_DINGHY) {
-						for (u32 j = 0; j < 3; ++j) {
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							game->map.units.push_back(invader);
-						}
-					}
-					if (unit->type == UNIT_RUSH_SHIP) {
-						for (u32 j = 0; j < 8; ++j) {
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							game->map.units.push_back(invader);
-						}
-						invader.type = UNIT_ELITE;
-						invader.hp = 6;
-						invader.damage = 4;
-						invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-						game->map.units.push_back(invader);
-
-						invader.type = UNIT_MAGE;
-						invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-						game->map.units.push_back(invader);
-
-						invader.type = UNIT_STONETHROWER;
-						invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-						game->map.units.push_back(invader);
-					}
-					if (unit->type == UNIT_MAGE_SHIP) {
-						for (u32 j = 0; j < 2; ++j) {
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							game->map.units.push_back(invader);
-						}
-						for (u32 j = 0; j < 3; ++j) {
-							invader.hp = 5;
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							invader.type = UNIT_MAGE;
-							game->map.units.push_back(invader);
-						}
-					}
-					if (unit->type == UNIT_STONETHROWER_SHIP) {
-						for (u32 j = 0; j < 2; ++j) {
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							game->map.units.push_back(invader);
-						}
-						for (u32 j = 0; j < 3; ++j) {
-							invader.hp = 5;
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							invader.type = UNIT_STONETHROWER;
-							game->map.units.push_back(invader);
-						}
-					}
-					if (unit->type == UNIT_ELITE_SHIP) {
-						invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-						game->map.units.push_back(invader);
-						for (u32 j = 0; j < 3; ++j) {
-							invader.hp = 6;
-							invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
-							invader.type = UNIT_ELITE;
+					//spawn invaders. Growing the list would move the boat out from under unit, so
+					//make room for them up front
+					game->map.units.reserve(game->map.units.size() + unload_count(unit->type));
+					unit = &game->map.units[i];
+					//a lone boss has nobody to plan for
+					u16 squad = unload_count(unit->type) > 1 ? create_squad(&game->map, unit->origin, unload_count(unit->type)) : 0;
+					u16 slot = 0;
+					for (u32 j = 0; j < archetype->numSpawns; ++j) {
+						const SpawnEntry* spawn = &archetype->spawns[j];
+						const UnitArchetype* spawned = get_archetype(spawn->type);
+						Unit invader = { 0 };
+						invader.type = spawn->type;
+						invader.state = UNIT_IDLE;
+						invader.owner = OWNER_INVADERS;
+						invader.hp = spawn->hp;
+						invader.damage = spawn->damage;
+						invader.origin = unit->origin;
+						invader.squad = squad;
+						if (spawned->flags & ARCHETYPE_BOSS)
+							invader.maxHp = spawn->hp;
+						if (spawned->flags & ARCHETYPE_STRANDED)
+							invader.origin = { -1, -1 };
+
+						for (u32 k = 0; k < spawn->count; ++k) {
+							invader.squadSlot = slot++;
+							if (spawned->flags & ARCHETYPE_BOSS)
+								invader.pos = { unit->pos.x, unit->pos.y };
+							else
+								invader.pos = { (f32)random_int(unit->pos.x - 5, unit->pos.x + 5), (f32)random_int(unit->pos.y - 5, unit->pos.y + 5) };
 							game->map.units.push_back(invader);
 						}
 					}
-					if (unit->type == UNIT_GOLIATH_SHIP) {
-						invader.type = UNIT_GOLIATH;
-						invader.hp = invader.maxHp = 60;
-						invader.damage = 3;
-						invader.origin = { -1, -1 };
-						invader.pos = { unit->pos.x, unit->pos.y };
-						game->map.units.push_back(invader);
-					}
-					if (unit->type == UNIT_EDRIC_SHIP) {
-						invader.type = UNIT_EDRIC;
-						invader.hp = invader.maxHp = 55;
-						invader.damage = 20;
-						invader.origin = { -1, -1 };
-						invader.pos = { unit->pos.x, unit->pos.y };
-						game->map.units.push_back(invader);
-					}
-					if (unit->type == UNIT_ULTIMATE_BOSS_SHIP) {
-						invader.type = UNIT_ULTIMATE_BOSS;
-						invader.hp = invader.maxHp = 1000;
-						invader.damage = 30;
-						invader.pos = { unit->pos.x, unit->pos.y };
-						game->map.units.push_back(invader);
-					}
 
 					unit->dest = unit->origin;
 					unit->state = UNIT_WALKING;
@@ -1342,27 +2330,21 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			}
 		}
 	}
+}
 
+static inline
+void update_projectiles(Game* game, MapScene* scene) {
 	//update cannonballs position then remove cannonball, deal damage, and push an explosion upon collision.
 	for (u16 i = 0; i < game->map.projectiles.size(); ++i) {
 		Projectile* proj = &game->map.projectiles[i];
 
-		if (proj->type == PROJECTILE_CANNONBALL)
-			draw_texture_rotated(batch, scene->cannonBall, proj->x + game->map.x, proj->y + game->map.y, proj->rotation);
-		if (proj->type == PROJECTILE_FIREBALL) {
+		if (proj->type == PROJECTILE_FIREBALL)
 			update_animation(&proj->animation, game->timer);
-			draw_animation(batch, proj->animation, proj->x + game->map.x, proj->y + game->map.y);
-		}
-		if (proj->type == PROJECTILE_BOULDER) {
-			draw_texture_rotated(batch, scene->boulder, proj->x + game->map.x, proj->y + game->map.y, proj->rotation);
-		}
-		if (proj->type == PROJECTILE_STONE)
-			draw_texture_rotated(batch, scene->stone, proj->x + game->map.x, proj->y + game->map.y, proj->rotation);
 
 		proj->x += cos(deg_to_rad(proj->rotation)) * 6;
 		proj->y += sin(deg_to_rad(proj->rotation)) * 6;
 
-		if (proj->x > game->map.width * TILE_SIZE || proj->y > game->map.height * TILE_SIZE || proj->x < 0 || proj->y < 0) {
+		if (proj->x > (i32)(game->map.width * TILE_SIZE) || proj->y > (i32)(game->map.height * TILE_SIZE) || proj->x < 0 || proj->y < 0) {
 			game->map.projectiles.erase(game->map.projectiles.begin() + i);
 			continue;
 		}
@@ -1373,9 +2355,14 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		f32 height = proj->type == PROJECTILE_FIREBALL ? 39 : proj->type == PROJECTILE_BOULDER ? scene->boulder.height : scene->cannonBall.height;
 
 		if (proj->owner == OWNER_INVADERS) {
-
-			for (u16 x = 0; x < game->map.width; ++x) {
-				for (u16 y = 0; y < game->map.height; ++y) {
+			//the projectile can only overlap the tiles under it and their neighbours
+			i32 x0 = std::max(0, (proj->x / TILE_SIZE) - 1);
+			i32 y0 = std::max(0, (proj->y / TILE_SIZE) - 1);
+			i32 x1 = std::min((i32)game->map.width - 1, (i32)((proj->x + width) / TILE_SIZE) + 1);
+			i32 y1 = std::min((i32)game->map.height - 1, (i32)((proj->y + height) / TILE_SIZE) + 1);
+
+			for (i32 x = x0; x <= x1; ++x) {
+				for (i32 y = y0; y <= y1; ++y) {
 					Wall* curr = &game->map.walls[x + y * game->map.width];
 
 					if (curr->active) {
@@ -1390,6 +2377,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 							else
 								curr->hp -= CANNON_DAMAGE;
 
+							if (curr->hp <= 0)
+								destroy_wall(&game->map, scene, x, y);
+
 							play_sound(scene->explosionBang);
 							Explosion explosion = { 0 };
 							explosion.animation = create_animation("explode", scene->explosion, 5, 74, 75, ANIMATION_DELAY, proj->type == PROJECTILE_CANNONBALL ? 0.6 : 1.5);
@@ -1412,8 +2402,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			for (u16 j = 0; j < game->map.units.size(); ++j) {
 				Unit* curr = &game->map.units[j];
 
-				f32 cwidth = curr->type == UNIT_ULTIMATE_BOSS ? scene->bigBoss.width : curr->type == UNIT_GOLIATH ? scene->goliath.width : scene->attackers[0].width;
-				f32 cheight = curr->type == UNIT_ULTIMATE_BOSS ? scene->bigBoss.height : curr->type == UNIT_GOLIATH ? scene->goliath.height : scene->attackers[0].height;
+				Texture hitbox = get_sprite(scene, get_archetype(curr->type)->hitbox);
+				f32 cwidth = hitbox.width;
+				f32 cheight = hitbox.height;
 
 				if (colliding(
 					{ (f32)proj->x, (f32)proj->y, width, height },
@@ -1448,15 +2439,326 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			}
 		}
 	}
+}
 
+static inline
+void update_explosions(Game* game) {
 	//update explosion animation and remove when finished
 	for (u32 i = 0; i < game->map.explosions.size(); ++i) {
 		Explosion* curr = &game->map.explosions[i];
 		update_animation(&curr->animation, game->timer);
-		draw_animation(batch, curr->animation, curr->x + game->map.x, curr->y + game->map.y);
 		if (curr->animation.current == curr->animation.frames - 1)
 			game->map.explosions.erase(game->map.explosions.begin() + i);
 	}
+}
+
+//==========================================================================================
+//Description: Advances the game by one tick. Nothing in here draws, so it can run without
+//			   a window.
+//==========================================================================================
+static inline
+void update_game(Game* game, MapScene* scene, bool demo = false) {
+	{
+		PROFILE_SCOPE("spawn");
+		spawn_wave(game);
+	}
+	{
+		PROFILE_SCOPE("turrets");
+		update_turrets(game, scene);
+	}
+	{
+		PROFILE_SCOPE("retarget");
+		update_squads(&game->map);
+		update_retargeting(game);
+	}
+	{
+		PROFILE_SCOPE("steering");
+		update_units(game, scene);
+	}
+	{
+		PROFILE_SCOPE("integration");
+		integrate_units(game, scene);
+	}
+	{
+		PROFILE_SCOPE("projectiles");
+		update_projectiles(game, scene);
+	}
+	{
+		PROFILE_SCOPE("explosions");
+		update_explosions(game);
+	}
+
+	//the clock stays stopped during the planning phase before the first wave
+	if (demo || game->currentWave != 0)
+		game->timer++;
+	game->tick++;
+}
+
+static inline
+void queue_command(Game* game, CommandType type, i32 x = 0, i32 y = 0, BuildingType building = BUILDING_WALL) {
+	Command command = { game->tick, (u16)type, (u16)building, x, y };
+	game->commands.push_back(command);
+}
+
+static inline
+bool turret_at(Map* map, i32 x, i32 y) {
+	for (u16 i = 0; i < map->turrets.size(); ++i) {
+		if (map->turrets[i].x == x && map->turrets[i].y == y)
+			return true;
+	}
+	return false;
+}
+
+//walls go on empty ground or gates, everything else on top of a wall with nothing on it
+static inline
+bool can_place(Map* map, BuildingType building, i32 x, i32 y) {
+	if (x < 0 || y < 0 || x >= (i32)map->width || y >= (i32)map->height)
+		return false;
+	Wall* wall = &map->walls[x + y * map->width];
+	if (building == BUILDING_WALL)
+		return !wall->active || wall->gate;
+	return wall->active && !turret_at(map, x, y);
+}
+
+static inline
+i32 repair_cost(Wall* wall) {
+	return 100 - (((f32)wall->hp / (f32)WALL_HP) * (f32)WALL_COST);
+}
+
+static inline
+void build(Game* game, MapScene* scene, BuildingType building, i32 x, i32 y) {
+	if (!can_place(&game->map, building, x, y) || game->map.grid[0][x + y * game->map.width] == 72)
+		return;
+
+	if (building == BUILDING_WALL) {
+		if (WALL_COST <= game->money) {
+			game->money -= WALL_COST;
+			play_sound(scene->click);
+
+			Wall wall = { 0 };
+			wall.hp = WALL_HP;
+			wall.adjacency = 6;
+			wall.gate = false;
+			wall.active = true;
+			game->map.walls[x + y * game->map.width] = wall;
+
+			orient_walls_around(&game->map, x, y);
+		}
+		else
+			push_notification(game, "You do not have enough gold to build a wall");
+		return;
+	}
+
+	Turret turret = { 0 };
+	turret.x = x;
+	turret.y = y;
+	i32 cost = 0;
+	const char* tooPoor = "";
+	if (building == BUILDING_CANNON) {
+		turret.type = TURRET_CANNON;
+		turret.shotDelay = 140;
+		cost = CANNON_COST;
+		tooPoor = "You do not have enough gold to build a cannon";
+	}
+	else if (building == BUILDING_MAGE) {
+		turret.type = TURRET_MAGE;
+		turret.shotDelay = 300;
+		cost = MAGE_COST;
+		tooPoor = "You do not have enough gold to train a mage";
+	}
+	else if (building == BUILDING_STONETHROWER) {
+		turret.type = TURRET_STONETHROWER;
+		turret.shotDelay = 105;
+		cost = STONETHROWER_COST;
+		tooPoor = "You do not have enough gold to train a stone thrower";
+	}
+	else {
+		return;
+	}
+
+	if ((u32)cost <= game->money) {
+		game->money -= cost;
+		play_sound(scene->click);
+		game->map.turrets.push_back(turret);
+	}
+	else
+		push_notification(game, tooPoor);
+}
+
+//a turret on the tile is sold before the wall under it
+static inline
+void sell(Game* game, i32 x, i32 y) {
+	if (x < 0 || y < 0 || x >= (i32)game->map.width || y >= (i32)game->map.height)
+		return;
+	Wall* wall = &game->map.walls[x + y * game->map.width];
+
+	for (u32 i = 0; i < game->map.turrets.size(); ++i) {
+		Turret* curr = &game->map.turrets[i];
+		if (curr->x == x && curr->y == y) {
+			if (wall->active)
+				game->money += curr->type == TURRET_CANNON ? CANNON_COST : curr->type == TURRET_MAGE ? MAGE_COST : 100;
+			game->map.turrets.erase(game->map.turrets.begin() + i);
+			return;
+		}
+	}
+
+	if (wall->active) {
+		game->money += (i32)(((f32)wall->hp / (f32)WALL_HP) * (f32)WALL_COST);
+		wall->hp = 0;
+		wall->active = false;
+		orient_walls_around(&game->map, x, y);
+	}
+}
+
+static inline
+void repair(Game* game, i32 x, i32 y) {
+	if (x < 0 || y < 0 || x >= (i32)game->map.width || y >= (i32)game->map.height)
+		return;
+	Wall* wall = &game->map.walls[x + y * game->map.width];
+	if (!wall->active)
+		return;
+
+	i32 cost = repair_cost(wall);
+	if (game->money >= (u32)cost) {
+		game->money -= cost;
+		wall->hp = WALL_HP;
+	}
+	else
+		push_notification(game, "Not enough gold to repair this building");
+}
+
+static inline
+void apply_command(Game* game, MapScene* scene, Command* command) {
+	switch (command->type) {
+	case COMMAND_BUILD:
+		build(game, scene, (BuildingType)command->building, command->x, command->y);
+		break;
+	case COMMAND_SELL:
+		sell(game, command->x, command->y);
+		break;
+	case COMMAND_REPAIR:
+		repair(game, command->x, command->y);
+		break;
+	case COMMAND_READY:
+		game->currentWave++;
+		game->timer = game->nextWaveTime - 50;
+		break;
+	case COMMAND_RESET:
+		for (u32 i = 0; i < game->map.turrets.size(); ++i) {
+			Turret* curr = &game->map.turrets[i];
+			game->money += curr->type == TURRET_CANNON ? CANNON_COST : TURRET_MAGE ? MAGE_COST : 0;
+		}
+		game->map.turrets.clear();
+
+		for (u32 x = 0; x < game->map.width; ++x) {
+			for (u32 y = 0; y < game->map.height; ++y) {
+				Wall* curr = &game->map.walls[x + y * game->map.width];
+				if (curr->active)
+					game->money += WALL_COST;
+				curr->active = false;
+			}
+		}
+		break;
+	case COMMAND_CAMERA:
+		game->map.x = command->x;
+		game->map.y = command->y;
+		break;
+	case COMMAND_SET_MONEY:
+		game->money = command->x;
+		break;
+	}
+}
+
+//applies what the player queued this frame, or while a replay plays, what was recorded
+//for this tick instead
+static inline
+void apply_commands(Game* game, MapScene* scene, Replay* replay) {
+	if (replay != NULL && replay->playing) {
+		game->commands.clear();
+		while (replay->cursor < replay->commands.size() && replay->commands[replay->cursor].tick <= game->tick)
+			apply_command(game, scene, &replay->commands[replay->cursor++]);
+		if (replay->cursor == replay->commands.size() && game->tick >= replay->ticks) {
+			push_notification(game, "Replay finished");
+			replay->playing = false;
+		}
+		return;
+	}
+
+	for (u32 i = 0; i < game->commands.size(); ++i) {
+		apply_command(game, scene, &game->commands[i]);
+		if (replay != NULL && replay->recording)
+			replay->commands.push_back(game->commands[i]);
+	}
+	game->commands.clear();
+	if (replay != NULL && replay->recording)
+		replay->ticks = game->tick;
+}
+
+static inline
+void draw_entities(RenderBatch* batch, Game* game, MapScene* scene) {
+	for (u16 i = 0; i < game->map.turrets.size(); ++i) {
+		Turret* turret = &game->map.turrets[i];
+		Texture turretTex = turret->type == TURRET_CANNON ? scene->cannon : turret->type == TURRET_MAGE ? scene->mage : scene->stonethrower;
+		if (!on_screen_rotated(&game->map, turret->x * TILE_SIZE, turret->y * TILE_SIZE, turretTex.width, turretTex.height)) {
+			add_culled_sprites(batch);
+			continue;
+		}
+
+		if (turret->type == TURRET_CANNON)
+			draw_texture_rotated(batch, scene->cannon, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y, turret->rotation);
+		if (turret->type == TURRET_MAGE)
+			draw_texture(batch, scene->mage, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y);
+		if(turret->type == TURRET_STONETHROWER)
+			draw_texture(batch, scene->stonethrower, (turret->x * TILE_SIZE) + game->map.x, (turret->y * TILE_SIZE) + game->map.y);
+	}
+
+	for (u16 i = 0; i < game->map.projectiles.size(); ++i) {
+		Projectile* proj = &game->map.projectiles[i];
+		Texture projTex = proj->type == PROJECTILE_CANNONBALL ? scene->cannonBall : proj->type == PROJECTILE_BOULDER ? scene->boulder : scene->stone;
+		if (proj->type == PROJECTILE_FIREBALL) {
+			if (on_screen(&game->map, proj->x, proj->y, proj->animation.width * proj->animation.scale, proj->animation.height * proj->animation.scale))
+				draw_animation(batch, proj->animation, proj->x + game->map.x, proj->y + game->map.y);
+			else
+				add_culled_sprites(batch);
+		}
+		else if (on_screen_rotated(&game->map, proj->x, proj->y, projTex.width, projTex.height)) {
+			draw_texture_rotated(batch, projTex, proj->x + game->map.x, proj->y + game->map.y, proj->rotation);
+		}
+		else {
+			add_culled_sprites(batch);
+		}
+	}
+
+	for (u32 i = 0; i < game->map.explosions.size(); ++i) {
+		Explosion* curr = &game->map.explosions[i];
+		if (on_screen(&game->map, curr->x, curr->y, curr->animation.width * curr->animation.scale, curr->animation.height * curr->animation.scale))
+			draw_animation(batch, curr->animation, curr->x + game->map.x, curr->y + game->map.y);
+		else
+			add_culled_sprites(batch);
+	}
+}
+
+static inline
+void draw_boss_bars(RenderBatch* batch, Game* game, MapScene* scene) {
+	for (u16 i = 0; i < game->map.units.size(); ++i) {
+		Unit* unit = &game->map.units[i];
+		if (has_flag(unit->type, ARCHETYPE_BOSS)) {
+			const char* name = get_archetype(unit->type)->name;
+			draw_text(batch, &scene->font, name, (get_window_width() / 2) - (get_string_width(&scene->font, name) / 2), get_window_height() - 55);
+
+			f32 width = ((f32)((f32)unit->hp / (f32)unit->maxHp) * get_window_width());
+			i32 xPos = (get_window_width() / 2) - ((scene->barleft.width + width) / 2);
+			draw_texture(batch, scene->barleft, xPos, get_window_height() - 20);
+			draw_texture_EX(batch, scene->barmid, { 0, 0, (f32)scene->barmid.width, (f32)scene->barmid.height }, { (f32)(xPos += scene->barleft.width), (f32)(get_window_height() - 20), width, (f32)scene->barmid.height });
+			draw_texture(batch, scene->barright, xPos += width, get_window_height() - 20);
+		}
+	}
+}
+
+//menus, hotkeys and the camera
+static inline
+void game_ui(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState* mainstate, bool demo) {
+	draw_boss_bars(batch, game, scene);
 
 	if (!demo) {
 #ifdef _DEBUG
@@ -1533,8 +2835,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->state = GAME_MENU;
 			return;
 		}
+		LOCAL const char* wallTooltip = duplicate_string(format_text("WALL\n---------------\nHOTKEY: W\nCOST: %d gold\nBuilds a wall\nthat prevents\ninvaders from\npassing through.", WALL_COST));
 		tooltip(batch, &scene->font, scene->ninepatch,
-			format_text("WALL\n---------------\nHOTKEY: W\nCOST: %d gold\nBuilds a wall\nthat prevents\ninvaders from\npassing through.", WALL_COST), 7, 8, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
+			wallTooltip, 7, 8, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
 			mouse
 		);
 		if (button(batch, scene->wallbutton, scene->wallbuttonDown, SIDEBAR_X_OFFSET + 10, yPos += 60, mouse)) {
@@ -1542,8 +2845,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->selectedBuilding = BUILDING_WALL;
 			game->state = GAME_BUILD;
 		}
+		LOCAL const char* stonethrowerTooltip = duplicate_string(format_text("STONE THROWER\n---------------\nHOTKEY: G\nCOST: %d gold\nTrains a stone\nthrower to defend\na wall. Attacks\nfaster than\na cannon, for less\ndamage. Can\nonly be put on\ntop of walls.", STONETHROWER_COST));
 		tooltip(batch, &scene->font, scene->ninepatch,
-			format_text("STONE THROWER\n---------------\nHOTKEY: G\nCOST: %d gold\nTrains a stone\nthrower to defend\na wall. Attacks\nfaster than\na cannon, for less\ndamage. Can\nonly be put on\ntop of walls.", STONETHROWER_COST), 7, 12, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
+			stonethrowerTooltip, 7, 12, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
 			mouse
 		);
 		if (button(batch, scene->stonebutton, scene->stonebutton_down, SIDEBAR_X_OFFSET + 10, yPos += 60, mouse)) {
@@ -1551,8 +2855,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->selectedBuilding = BUILDING_STONETHROWER;
 			game->state = GAME_BUILD;
 		}
+		LOCAL const char* cannonTooltip = duplicate_string(format_text("CANNON\n---------------\nHOTKEY: C\nCOST: %d gold\nBuilds a cannon\nthat shoots at\noncoming\ninvaders. Can\nonly be built on\ntop of walls.", CANNON_COST));
 		tooltip(batch, &scene->font, scene->ninepatch,
-			format_text("CANNON\n---------------\nHOTKEY: C\nCOST: %d gold\nBuilds a cannon\nthat shoots at\noncoming\ninvaders. Can\nonly be built on\ntop of walls.", CANNON_COST), 7, 10, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
+			cannonTooltip, 7, 10, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
 			mouse
 		);
 		if (button(batch, scene->cannonbutton, scene->cannonbutton_down, SIDEBAR_X_OFFSET + 10, yPos += 60, mouse)) {
@@ -1560,8 +2865,9 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			game->selectedBuilding = BUILDING_CANNON;
 			game->state = GAME_BUILD;
 		}
+		LOCAL const char* mageTooltip = duplicate_string(format_text("MAGE\n---------------\nHOTKEY: M\nCOST: %d gold\nTrains a mage\nto defend a wall.\nCasts fireballs at\noncoming invaders\nto do AOE damage.\nCan only be put on\ntop of walls.", MAGE_COST));
 		tooltip(batch, &scene->font, scene->ninepatch,
-			format_text("MAGE\n---------------\nHOTKEY: M\nCOST: %d gold\nTrains a mage\nto defend a wall.\nCasts fireballs at\noncoming invaders\nto do AOE damage.\nCan only be put on\ntop of walls.", MAGE_COST), 7, 11, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
+			mageTooltip, 7, 11, { SIDEBAR_X_OFFSET + 10, (f32)yPos + 60, (f32)scene->cancelbutton.width, (f32)scene->cancelbutton.height },
 			mouse
 		);
 		if (button(batch, scene->priestbutton, scene->priestbutton_down, SIDEBAR_X_OFFSET + 10, yPos += 60, mouse)) {
@@ -1614,115 +2920,23 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		x = (mouse.x - game->map.x) / TILE_SIZE;
 		y = (mouse.y - game->map.y) / TILE_SIZE;
 		//place selected building down where mouse is, then orient walls according to adjacencies
-		if (is_button_down(MOUSE_BUTTON_LEFT) && !mouseOnSidebar && x >= 0 && y >= 0 && x < game->map.width && y < game->map.height && !enemiesNearby) {
+		if (is_button_down(MOUSE_BUTTON_LEFT) && !mouseOnSidebar && x >= 0 && y >= 0 && x < (i32)game->map.width && y < (i32)game->map.height && !enemiesNearby) {
 
 			if (tileIsWater) {
 				push_notification(game, "Walls cannot be placed on water");
 			}
-			else {
-
-				if (game->selectedBuilding == BUILDING_WALL) {
-					bool isGate = game->map.walls[x + y * game->map.width].gate;
-					if (!game->map.walls[x + y * game->map.width].active || isGate) {
-						if (WALL_COST <= game->money) {
-							game->money -= WALL_COST;
-							play_sound(scene->click);
-
-							Wall wall = { 0 };
-							wall.hp = WALL_HP;
-							wall.adjacency = 6;
-							wall.gate = false;
-							wall.active = true;
-							game->map.walls[x + y * game->map.width] = wall;
-
-							orient_walls(&game->map);
-						}
-						else
-							push_notification(game, "You do not have enough gold to build a wall");
-					}
-					else if (is_button_pressed(MOUSE_BUTTON_LEFT))
-						push_notification(game, "Building location blocked");
-				}
-				if (game->selectedBuilding == BUILDING_CANNON) {
-					bool cannonPresent = false;
-					for (u16 i = 0; i < game->map.turrets.size(); ++i) {
-						if (game->map.turrets[i].x == x && game->map.turrets[i].y == y) {
-							cannonPresent = true;
-							break;
-						}
-					}
-					if (game->map.walls[x + y * game->map.width].active && !cannonPresent) {
-						if (CANNON_COST <= game->money) {
-							game->money -= CANNON_COST;
-							play_sound(scene->click);
-
-							Turret cannon = { 0 };
-							cannon.type = TURRET_CANNON;
-							cannon.shotDelay = 140;
-							cannon.x = (mouse.x - game->map.x) / TILE_SIZE;
-							cannon.y = (mouse.y - game->map.y) / TILE_SIZE;
-							game->map.turrets.push_back(cannon);
-						}
-						else
-							push_notification(game, "You do not have enough gold to build a cannon");
-					}
-					else if (is_button_pressed(MOUSE_BUTTON_LEFT))
-						push_notification(game, "You must place the cannon on an empty wall");
-				}
-
-				if (game->selectedBuilding == BUILDING_MAGE) {
-					bool cannonPresent = false;
-					for (u16 i = 0; i < game->map.turrets.size(); ++i) {
-						if (game->map.turrets[i].x == x && game->map.turrets[i].y == y) {
-							cannonPresent = true;
-							break;
-						}
-					}
-					if (game->map.walls[x + y * game->map.width].active && !cannonPresent) {
-						if (MAGE_COST <= game->money) {
-							game->money -= MAGE_COST;
-							play_sound(scene->click);
-
-							Turret mage = { 0 };
-							mage.type = TURRET_MAGE;
-							mage.shotDelay = 300;
-							mage.x = (mouse.x - game->map.x) / TILE_SIZE;
-							mage.y = (mouse.y - game->map.y) / TILE_SIZE;
-							game->map.turrets.push_back(mage);
-						}
-						else
-							push_notification(game, "You do not have enough gold to train a mage");
-					}
-					else if (is_button_pressed(MOUSE_BUTTON_LEFT))
-						push_notification(game, "You must place the mage on an empty wall");
-				}
-
-				if (game->selectedBuilding == BUILDING_STONETHROWER) {
-					bool cannonPresent = false;
-					for (u16 i = 0; i < game->map.turrets.size(); ++i) {
-						if (game->map.turrets[i].x == x && game->map.turrets[i].y == y) {
-							cannonPresent = true;
-							break;
-						}
-					}
-					if (game->map.walls[x + y * game->map.width].active && !cannonPresent) {
-						if (STONETHROWER_COST <= game->money) {
-							game->money -= STONETHROWER_COST;
-							play_sound(scene->click);
-
-							Turret mage = { 0 };
-							mage.type = TURRET_STONETHROWER;
-							mage.shotDelay = 105;
-							mage.x = (mouse.x - game->map.x) / TILE_SIZE;
-							mage.y = (mouse.y - game->map.y) / TILE_SIZE;
-							game->map.turrets.push_back(mage);
-						}
-						else
-							push_notification(game, "You do not have enough gold to train a stone thrower");
-					}
-					else if (is_button_pressed(MOUSE_BUTTON_LEFT))
-						push_notification(game, "You must place the stone thrower on an empty wall");
-				}
+			else if (can_place(&game->map, game->selectedBuilding, x, y)) {
+				queue_command(game, COMMAND_BUILD, x, y, game->selectedBuilding);
+			}
+			else if (is_button_pressed(MOUSE_BUTTON_LEFT)) {
+				if (game->selectedBuilding == BUILDING_WALL)
+					push_notification(game, "Building location blocked");
+				if (game->selectedBuilding == BUILDING_CANNON)
+					push_notification(game, "You must place the cannon on an empty wall");
+				if (game->selectedBuilding == BUILDING_MAGE)
+					push_notification(game, "You must place the mage on an empty wall");
+				if (game->selectedBuilding == BUILDING_STONETHROWER)
+					push_notification(game, "You must place the stone thrower on an empty wall");
 			}
 		}
 	}
@@ -1757,17 +2971,13 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 	}
 	if (game->state == GAME_REPAIR) {
 		if (onWall) {
-			i32 cost = 100 - (((f32)mousedOver->hp / (f32)WALL_HP) * (f32)WALL_COST);
+			i32 cost = repair_cost(mousedOver);
 			tooltip(batch, &scene->font, scene->ninepatch, format_text("Wall HP: %d\n\nRepair Cost: %d gold", mousedOver->hp, cost), 8, 2, { mouse.x, mouse.y, 1, 1 }, mouse);
 			if (enemiesNearby && is_button_down(MOUSE_BUTTON_LEFT))
 				push_notification(game, "Cannot repair with enemies nearby");
 
-			if (!enemiesNearby && is_button_released(MOUSE_BUTTON_LEFT) && game->money >= cost) {
-				game->money -= cost;
-				mousedOver->hp = WALL_HP;
-			}
-			if (game->money < cost && is_button_released(MOUSE_BUTTON_LEFT))
-				push_notification(game, "Not enough gold to repair this building");
+			if (!enemiesNearby && is_button_released(MOUSE_BUTTON_LEFT))
+				queue_command(game, COMMAND_REPAIR, (mouse.x - game->map.x) / TILE_SIZE, (mouse.y - game->map.y) / TILE_SIZE);
 		}
 	}
 	if (game->state == GAME_SELL) {
@@ -1798,16 +3008,10 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 				push_notification(game, "Cannot sell with enemies nearby");
 
 			if (!enemiesNearby && is_button_released(MOUSE_BUTTON_LEFT)) {
-				if (onTurret) {
-					game->money += value;
-					game->map.turrets.erase(game->map.turrets.begin() + mousedTurretNdx);
-				}
-				else if (onWall) {
-					game->money += value;
-					mousedOver->hp = 0;
-					mousedOver->active = false;
-					orient_walls(&game->map);
-				}
+				if (onTurret)
+					queue_command(game, COMMAND_SELL, game->map.turrets[mousedTurretNdx].x, game->map.turrets[mousedTurretNdx].y);
+				else
+					queue_command(game, COMMAND_SELL, (mouse.x - game->map.x) / TILE_SIZE, (mouse.y - game->map.y) / TILE_SIZE);
 			}
 		}
 	}
@@ -1843,10 +3047,8 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 
 		i32 xPos = (get_window_width() / 2) - (scene->buttonlong.width / 2);
 		i32 yPos = get_window_height() - 100;
-		if (button(batch, scene->buttonlong, scene->buttonlong_down, xPos, yPos, mouse)) {
-			game->currentWave++;
-			game->timer = game->nextWaveTime - 50;
-		}
+		if (button(batch, scene->buttonlong, scene->buttonlong_down, xPos, yPos, mouse))
+			queue_command(game, COMMAND_READY);
 		Rect btnrect = { xPos, yPos, scene->buttonlong.width,  scene->buttonlong.height };
 		bool collided = colliding(btnrect, mouse.x, mouse.y);
 		if (is_button_down(MOUSE_BUTTON_LEFT) && collided)
@@ -1855,22 +3057,8 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 			draw_text(batch, &scene->font, "Ready", xPos + 55, yPos + 6);
 
 		yPos -= 50;
-		if (button(batch, scene->buttonlong, scene->buttonlong_down, xPos, yPos, mouse)) {
-			for (u32 i = 0; i < game->map.turrets.size(); ++i) {
-				Turret* curr = &game->map.turrets[i];
-				game->money += curr->type == TURRET_CANNON ? CANNON_COST : TURRET_MAGE ? MAGE_COST : 0;
-			}
-			game->map.turrets.clear();
-
-			for (u32 x = 0; x < game->map.width; ++x) {
-				for (u32 y = 0; y < game->map.height; ++y) {
-					Wall* curr = &game->map.walls[x + y * game->map.width];
-					if (curr->active)
-						game->money += WALL_COST;
-					curr->active = false;
-				}
-			}
-		}
+		if (button(batch, scene->buttonlong, scene->buttonlong_down, xPos, yPos, mouse))
+			queue_command(game, COMMAND_RESET);
 		btnrect = { (f32)xPos, (f32)yPos, (f32)scene->buttonlong.width, (f32)scene->buttonlong.height };
 		collided = colliding(btnrect, mouse.x, mouse.y);
 		if (is_button_down(MOUSE_BUTTON_LEFT) && collided)
@@ -1878,8 +3066,6 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		else
 			draw_text(batch, &scene->font, "Reset", xPos + 55, yPos + 6);
 	}
-	else
-		game->timer++;
 
 	if (game->currentWave > game->waves.size() - 1 && game->map.units.size() == 0) {
 		i32 xPos = (get_window_width() / 2) - (scene->buttonlong.width / 2);
@@ -1935,7 +3121,7 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 		*mainstate = MAIN_TITLE;
 	}
 	if (is_key_down(KEY_Z) && is_key_down(KEY_X) && is_key_down(KEY_O) && is_key_down(KEY_P)) {
-		game->money = 99999;
+		queue_command(game, COMMAND_SET_MONEY, 99999);
 	}
 
 	if (game->state == GAME_BUILD_MENU || game->state == GAME_BUILD) {
@@ -1959,16 +3145,39 @@ void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState
 
 	//move camera
 	if (!demo) {
+		i32 camx = game->map.x;
+		i32 camy = game->map.y;
 		if ((is_key_down(KEY_LEFT) || (mouse.x < 30) && mouse.y > sidebarHeight) && game->map.x < 0)
-			game->map.x += 16;
-		if ((is_key_down(KEY_RIGHT) || mouse.x > get_window_width() - 60) && game->map.x > (-game->map.width * TILE_SIZE) + get_window_width())
-			game->map.x -= 16;
-		if ((is_key_down(KEY_DOWN) || mouse.y > get_window_height() - 60) && game->map.y > (-game->map.height * TILE_SIZE) + get_window_height())
-			game->map.y -= 16;
+			camx += 16;
+		if ((is_key_down(KEY_RIGHT) || mouse.x > get_window_width() - 60) && game->map.x > (-(i32)game->map.width * TILE_SIZE) + get_window_width())
+			camx -= 16;
+		if ((is_key_down(KEY_DOWN) || mouse.y > get_window_height() - 60) && game->map.y > (-(i32)game->map.height * TILE_SIZE) + get_window_height())
+			camy -= 16;
 		if ((is_key_down(KEY_UP) || mouse.y < 30) && game->map.y < 0)
-			game->map.y += 16;
+			camy += 16;
+		if (camx != (i32)game->map.x || camy != (i32)game->map.y)
+			queue_command(game, COMMAND_CAMERA, camx, camy);
 	}
+	
+}
+
+static inline
+void game(RenderBatch* batch, Game* game, MapScene* scene, vec2 mouse, MainState* mainstate, bool demo = false, Replay* replay = NULL) {
+	{
+		PROFILE_SCOPE("simulation");
+		update_game(game, scene, demo);
 	}
+	{
+		PROFILE_SCOPE("draw_map");
+		draw_map(batch, &game->map, scene);
+		draw_entities(batch, game, scene);
+	}
+	{
+		PROFILE_SCOPE("ui");
+		game_ui(batch, game, scene, mouse, mainstate, demo);
+		apply_commands(game, scene, replay);
+	}
+}
 
 static inline
 void editor(RenderBatch* batch, Editor* editor, MapScene* scene, vec2 mouse) {
@@ -2010,54 +3219,19 @@ void editor(RenderBatch* batch, Editor* editor, MapScene* scene, vec2 mouse) {
 	}
 	if (is_key_released(KEY_F5)) {
 		//save
-		FILE *file = fopen("data/map.txt", "w");
-		if (file == NULL)
-			BMT_LOG(FATAL_ERROR, "Error opening file");
-
-		fprintf(file, "#map\n");
-		fprintf(file, "#layer1\n");
-		fprintf(file, "%d\n", editor->map.width);
-		fprintf(file, "%d\n", editor->map.height);
-		for (u16 i = 0; i < editor->map.width * editor->map.height; ++i)
-			fprintf(file, "%d ", editor->map.grid[0][i]);
-		fprintf(file, "\n");
-
-		fprintf(file, "#layer2\n");
-		for (u16 i = 0; i < editor->map.width * editor->map.height; ++i)
-			fprintf(file, "%d ", editor->map.grid[1][i]);
-		fprintf(file, "\n");
-
-		fprintf(file, "#layer3\n");
-		for (u16 i = 0; i < editor->map.width * editor->map.height; ++i)
-			fprintf(file, "%d ", editor->map.grid[2][i]);
-		fprintf(file, "\n");
-
-		fprintf(file, "#units\n");
-		fprintf(file, "%d\n", editor->map.units.size());
-		for (u16 i = 0; i < editor->map.units.size(); ++i) {
-			Unit* curr = &editor->map.units[i];
-			fprintf(file, "%d %d %d %d %d %d\n", curr->pos.x, curr->pos.y, curr->hp, curr->maxHp, (i32)curr->type, (i32)curr->owner);
-		}
-
-		fprintf(file, "#buildings\n");
-		for (u16 x = 0; x < editor->map.width; ++x) {
-			for (u16 y = 0; y < editor->map.height; ++y) {
-				Wall* curr = &editor->map.walls[x + y * editor->map.width];
-				if (curr->active)
-					fprintf(file, "%d %d %d\n", x, y, curr->hp);
-			}
-		}
-
-		fclose(file);
+		save_map(&editor->map, "data/map.txt");
 	}
 	if (is_key_released(KEY_F6)) {
 		//load
+		dispose_map(map);
 		editor->map = load_map("data/map.txt");
 	}
 	if (is_key_released(KEY_F7)) {
 		//new
-		editor->map.units.clear();
-		editor->map = create_map(map->width, map->height);
+		u32 width = map->width;
+		u32 height = map->height;
+		dispose_map(map);
+		editor->map = create_map(width, height);
 	}
 	if (is_button_released(MOUSE_BUTTON_RIGHT)) {
 		editor->selectedShip = 0;
@@ -0,0 +1,118 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "levels.h"
+
+//A replay is the seed and level a game started from plus every Command the player issued,
+//stamped with the tick it was applied after. Starting the same level from the same seed
+//and applying the same commands at the same ticks gives the same game, so a replay can be
+//watched (--replay), or run headless by sim_bench as a repeatable benchmark.
+//
+//file layout: ReplayHeader, the scenario path (fileLength bytes, no terminator), then
+//numCommands Commands
+
+#define REPLAY_VERSION	1
+
+GLOBAL const char REPLAY_MAGIC[4] = { 'B', 'R', 'P', 'L' };
+
+struct ReplayHeader {
+	char magic[4];
+	u32 version;
+	u32 seed;
+	i32 level;			//index into the levels, or -1 when the game started from a scenario file
+	u32 ticks;
+	u32 numCommands;
+	u32 fileLength;
+	u32 reserved;
+};
+
+//seeds the random engine, so call it before the level is loaded
+static inline
+void start_recording(Replay* replay, i32 level, const char* scenariofile) {
+	*replay = Replay();
+	replay->seed = std::random_device{}();
+	replay->level = level;
+	replay->file = scenariofile != NULL ? scenariofile : "";
+	replay->recording = true;
+	seed_random(replay->seed);
+}
+
+static inline
+bool save_replay(Replay* replay, const char* filename) {
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Error opening file", filename);
+		return false;
+	}
+
+	ReplayHeader header = { 0 };
+	memcpy(header.magic, REPLAY_MAGIC, 4);
+	header.version = REPLAY_VERSION;
+	header.seed = replay->seed;
+	header.level = replay->level;
+	header.ticks = replay->ticks;
+	header.numCommands = replay->commands.size();
+	header.fileLength = replay->file.size();
+
+	bool written = fwrite(&header, sizeof(ReplayHeader), 1, file) == 1;
+	written = written && fwrite(replay->file.data(), 1, header.fileLength, file) == header.fileLength;
+	written = written && fwrite(replay->commands.data(), sizeof(Command), header.numCommands, file) == header.numCommands;
+	fclose(file);
+	return written;
+}
+
+static inline
+bool load_replay(Replay* replay, const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Error opening file", filename);
+		return false;
+	}
+
+	ReplayHeader header = { 0 };
+	if (fread(&header, sizeof(ReplayHeader), 1, file) != 1 || memcmp(header.magic, REPLAY_MAGIC, 4) != 0) {
+		BMT_LOG(WARNING, "[%s] Not a replay", filename);
+		fclose(file);
+		return false;
+	}
+	if (header.version != REPLAY_VERSION) {
+		BMT_LOG(WARNING, "[%s] Replay version %d is not supported", filename, header.version);
+		fclose(file);
+		return false;
+	}
+	if (header.level < 0 && header.fileLength == 0) {
+		BMT_LOG(WARNING, "[%s] Replay has no level or scenario to start from", filename);
+		fclose(file);
+		return false;
+	}
+
+	Replay loaded;
+	loaded.seed = header.seed;
+	loaded.level = header.level;
+	loaded.ticks = header.ticks;
+	loaded.file.resize(header.fileLength);
+	loaded.commands.resize(header.numCommands);
+	bool read = fread(&loaded.file[0], 1, header.fileLength, file) == header.fileLength;
+	read = read && fread(loaded.commands.data(), sizeof(Command), header.numCommands, file) == header.numCommands;
+	fclose(file);
+	if (!read) {
+		BMT_LOG(WARNING, "[%s] Replay is cut short", filename);
+		return false;
+	}
+
+	*replay = loaded;
+	return true;
+}
+
+//sets up the game the replay was recorded from and starts playing it back
+static inline
+Game start_replay(Replay* replay, LevelTable* levels) {
+	seed_random(replay->seed);
+	Game game = replay->level >= 0 ? load_level(levels, replay->level) : load_scenario(replay->file.c_str());
+	replay->cursor = 0;
+	replay->recording = false;
+	replay->playing = true;
+	return game;
+}
+
+#endif
@@ -0,0 +1,579 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <type_traits>
+#include "map.h"
+
+//A snapshot is the whole Game in one binary blob: the map layers, walls, turrets, units,
+//squads, projectiles, explosions, waves, wave cursor, timers, money, notifications and the
+//random engine. Queued commands are left out, they never outlive the frame that queues them.
+//Plain structs are stored as they are in memory, so a snapshot only loads into the build
+//that wrote it; the header records the struct sizes to catch that. Unit targets are
+//stored as indices into the walls and gold piles, and animations as the scene texture
+//they were made from.
+
+#define SNAPSHOT_VERSION	4
+
+GLOBAL const char SNAPSHOT_MAGIC[4] = { 'B', 'S', 'N', 'P' };
+
+static_assert(std::is_trivially_copyable<std::mt19937>::value, "the random engine is saved as raw bytes");
+
+struct SnapshotHeader {
+	char magic[4];
+	u32 version;
+	u16 unitSize;
+	u16 wallSize;
+	u16 turretSize;
+	u16 goldpileSize;
+	u32 width;
+	u32 height;
+};
+
+struct SnapshotReader {
+	const u8* data;
+	u64 size;
+	u64 at;
+	bool failed;
+};
+
+enum SnapshotAnimation {
+	SNAPSHOT_ANIMATION_NONE,
+	SNAPSHOT_ANIMATION_FIRE,
+	SNAPSHOT_ANIMATION_EXPLOSION
+};
+
+static inline
+void write_bytes(std::vector<u8>* out, const void* data, u64 size) {
+	out->insert(out->end(), (const u8*)data, (const u8*)data + size);
+}
+
+static inline
+void write_u32(std::vector<u8>* out, u32 value) {
+	write_bytes(out, &value, sizeof(u32));
+}
+
+static inline
+void write_string(std::vector<u8>* out, const std::string& text) {
+	write_u32(out, text.size());
+	write_bytes(out, text.data(), text.size());
+}
+
+//a failed read leaves out zeroed and marks the reader, so callers check once at the end
+static inline
+bool read_bytes(SnapshotReader* in, void* out, u64 size) {
+	if (in->failed || size > in->size - in->at) {
+		in->failed = true;
+		memset(out, 0, size);
+		return false;
+	}
+	memcpy(out, in->data + in->at, size);
+	in->at += size;
+	return true;
+}
+
+static inline
+u32 read_u32(SnapshotReader* in) {
+	u32 value = 0;
+	read_bytes(in, &value, sizeof(u32));
+	return value;
+}
+
+//counts are checked against what is left so a corrupt one can't ask for gigabytes
+static inline
+u32 read_count(SnapshotReader* in, u64 elementSize) {
+	u32 count = read_u32(in);
+	if (elementSize > 0 && count > (in->size - in->at) / elementSize) {
+		in->failed = true;
+		return 0;
+	}
+	return count;
+}
+
+static inline
+std::string read_string(SnapshotReader* in) {
+	u32 length = read_count(in, 1);
+	std::string text(length, '\0');
+	read_bytes(in, &text[0], length);
+	return text;
+}
+
+static inline
+void write_animation(std::vector<u8>* out, Animation* anim) {
+	u32 kind = anim->identifier == "fire" ? SNAPSHOT_ANIMATION_FIRE : anim->identifier == "explode" ? SNAPSHOT_ANIMATION_EXPLOSION : SNAPSHOT_ANIMATION_NONE;
+	write_u32(out, kind);
+	write_bytes(out, &anim->frames, sizeof(anim->frames));
+	write_bytes(out, &anim->current, sizeof(anim->current));
+	write_bytes(out, &anim->width, sizeof(anim->width));
+	write_bytes(out, &anim->height, sizeof(anim->height));
+	write_bytes(out, &anim->delay, sizeof(anim->delay));
+	write_bytes(out, &anim->scale, sizeof(anim->scale));
+}
+
+static inline
+Animation read_animation(SnapshotReader* in, MapScene* scene) {
+	Animation anim;
+	u32 kind = read_u32(in);
+	if (kind == SNAPSHOT_ANIMATION_FIRE) {
+		anim.identifier = "fire";
+		anim.img = scene->fire;
+	}
+	else if (kind == SNAPSHOT_ANIMATION_EXPLOSION) {
+		anim.identifier = "explode";
+		anim.img = scene->explosion;
+	}
+	else {
+		anim.img = { 0 };
+	}
+	read_bytes(in, &anim.frames, sizeof(anim.frames));
+	read_bytes(in, &anim.current, sizeof(anim.current));
+	read_bytes(in, &anim.width, sizeof(anim.width));
+	read_bytes(in, &anim.height, sizeof(anim.height));
+	read_bytes(in, &anim.delay, sizeof(anim.delay));
+	read_bytes(in, &anim.scale, sizeof(anim.scale));
+	return anim;
+}
+
+static inline
+void write_snapshot(Game* game, std::vector<u8>* out) {
+	TRACE_SCOPE("write_snapshot");
+	Map* map = &game->map;
+	u32 size = map->width * map->height;
+	out->clear();
+	out->reserve(sizeof(SnapshotHeader) + size * (NUM_LAYERS * sizeof(i16) + sizeof(Wall)) + map->units.size() * (sizeof(Unit) + 2 * sizeof(i32)) + 4096);
+
+	SnapshotHeader header = { 0 };
+	memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+	header.version = SNAPSHOT_VERSION;
+	header.unitSize = sizeof(Unit);
+	header.wallSize = sizeof(Wall);
+	header.turretSize = sizeof(Turret);
+	header.goldpileSize = sizeof(GoldPile);
+	header.width = map->width;
+	header.height = map->height;
+	write_bytes(out, &header, sizeof(SnapshotHeader));
+
+	u32 state = game->state;
+	u32 selectedBuilding = game->selectedBuilding;
+	write_u32(out, state);
+	write_u32(out, selectedBuilding);
+	write_bytes(out, &game->numRain, sizeof(game->numRain));
+	write_u32(out, game->money);
+	write_u32(out, game->currentWave);
+	write_u32(out, game->nextWaveTime);
+	write_u32(out, game->timer);
+	write_u32(out, game->tick);
+	write_u32(out, game->retargetCursor);
+	write_bytes(out, &randomEngine, sizeof(randomEngine));
+
+	write_bytes(out, &map->x, sizeof(map->x));
+	write_bytes(out, &map->y, sizeof(map->y));
+	for (u32 i = 0; i < NUM_LAYERS; ++i)
+		write_bytes(out, map->grid[i], size * sizeof(i16));
+	write_bytes(out, map->walls, size * sizeof(Wall));
+
+	write_u32(out, map->goldpiles.size());
+	write_bytes(out, map->goldpiles.data(), map->goldpiles.size() * sizeof(GoldPile));
+	write_u32(out, map->turrets.size());
+	write_bytes(out, map->turrets.data(), map->turrets.size() * sizeof(Turret));
+
+	//units go in as they are, then their targets are swapped for indices, -1 for none
+	write_u32(out, map->units.size());
+	u64 unitsAt = out->size();
+	write_bytes(out, map->units.data(), map->units.size() * sizeof(Unit));
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		Unit* unit = &map->units[i];
+		i32 wall = unit->wtarget != NULL ? (i32)(unit->wtarget - map->walls) : -1;
+		i32 gold = unit->gtarget != NULL ? (i32)(unit->gtarget - map->goldpiles.data()) : -1;
+		write_bytes(out, &wall, sizeof(i32));
+		write_bytes(out, &gold, sizeof(i32));
+
+		Unit* saved = (Unit*)(out->data() + unitsAt) + i;
+		saved->wtarget = NULL;
+		saved->gtarget = NULL;
+	}
+	write_u32(out, map->squads.size());
+	write_bytes(out, map->squads.data(), map->squads.size() * sizeof(Squad));
+
+	write_u32(out, map->projectiles.size());
+	for (u32 i = 0; i < map->projectiles.size(); ++i) {
+		Projectile* proj = &map->projectiles[i];
+		u32 type = proj->type;
+		u32 owner = proj->owner;
+		write_bytes(out, &proj->x, sizeof(proj->x));
+		write_bytes(out, &proj->y, sizeof(proj->y));
+		write_bytes(out, &proj->rotation, sizeof(proj->rotation));
+		write_u32(out, type);
+		write_u32(out, owner);
+		write_animation(out, &proj->animation);
+	}
+
+	write_u32(out, map->explosions.size());
+	for (u32 i = 0; i < map->explosions.size(); ++i) {
+		Explosion* explosion = &map->explosions[i];
+		write_bytes(out, &explosion->x, sizeof(explosion->x));
+		write_bytes(out, &explosion->y, sizeof(explosion->y));
+		write_animation(out, &explosion->animation);
+	}
+
+	//waves are only ever spawned from, so their units have no targets to fix up
+	write_u32(out, game->waves.size());
+	for (u32 i = 0; i < game->waves.size(); ++i) {
+		write_u32(out, game->waves[i].size());
+		write_bytes(out, game->waves[i].data(), game->waves[i].size() * sizeof(Group));
+	}
+
+	write_u32(out, game->notifications.size());
+	for (u32 i = 0; i < game->notifications.size(); ++i) {
+		write_bytes(out, &game->notifications[i].alpha, sizeof(f32));
+		write_string(out, game->notifications[i].text);
+	}
+	write_u32(out, game->statusTexts.size());
+	for (u32 i = 0; i < game->statusTexts.size(); ++i) {
+		write_bytes(out, &game->statusTexts[i].alpha, sizeof(f32));
+		write_bytes(out, &game->statusTexts[i].pos, sizeof(vec2));
+		write_string(out, game->statusTexts[i].text);
+	}
+}
+
+//replaces game with the snapshot, or leaves it untouched and returns false if the
+//snapshot is from another build or is corrupt
+static inline
+bool read_snapshot(Game* game, MapScene* scene, const u8* data, u64 size) {
+	TRACE_SCOPE("read_snapshot");
+	SnapshotReader in = { data, size, 0, false };
+
+	SnapshotHeader header;
+	read_bytes(&in, &header, sizeof(SnapshotHeader));
+	if (in.failed || memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0) {
+		BMT_LOG(WARNING, "Not a snapshot");
+		return false;
+	}
+	if (header.version != SNAPSHOT_VERSION || header.unitSize != sizeof(Unit) || header.wallSize != sizeof(Wall) ||
+		header.turretSize != sizeof(Turret) || header.goldpileSize != sizeof(GoldPile)) {
+		BMT_LOG(WARNING, "Snapshot is from a different build (version %d)", header.version);
+		return false;
+	}
+	if (header.width == 0 || header.height == 0 || header.width > MAP_MAX_SIZE || header.height > MAP_MAX_SIZE) {
+		BMT_LOG(WARNING, "Snapshot map size %dx%d is out of range", header.width, header.height);
+		return false;
+	}
+
+	Game loaded = { GAME_IDLE };
+	loaded.state = (GameState)read_u32(&in);
+	loaded.selectedBuilding = (BuildingType)read_u32(&in);
+	read_bytes(&in, &loaded.numRain, sizeof(loaded.numRain));
+	loaded.money = read_u32(&in);
+	loaded.currentWave = read_u32(&in);
+	loaded.nextWaveTime = read_u32(&in);
+	loaded.timer = read_u32(&in);
+	loaded.tick = read_u32(&in);
+	loaded.retargetCursor = read_u32(&in);
+	std::mt19937 engine;
+	read_bytes(&in, &engine, sizeof(engine));
+
+	//the layers and walls are the bulk of it, check they are all there before allocating
+	u32 tiles = header.width * header.height;
+	if ((u64)tiles * (NUM_LAYERS * sizeof(i16) + sizeof(Wall)) > in.size - in.at) {
+		BMT_LOG(WARNING, "Snapshot is cut short");
+		return false;
+	}
+	Map* map = &loaded.map;
+	*map = create_map(header.width, header.height);
+	read_bytes(&in, &map->x, sizeof(map->x));
+	read_bytes(&in, &map->y, sizeof(map->y));
+	for (u32 i = 0; i < NUM_LAYERS; ++i)
+		read_bytes(&in, map->grid[i], tiles * sizeof(i16));
+	read_bytes(&in, map->walls, tiles * sizeof(Wall));
+
+	map->goldpiles.resize(read_count(&in, sizeof(GoldPile)));
+	read_bytes(&in, map->goldpiles.data(), map->goldpiles.size() * sizeof(GoldPile));
+	map->turrets.resize(read_count(&in, sizeof(Turret)));
+	read_bytes(&in, map->turrets.data(), map->turrets.size() * sizeof(Turret));
+
+	map->units.resize(read_count(&in, sizeof(Unit) + 2 * sizeof(i32)));
+	read_bytes(&in, map->units.data(), map->units.size() * sizeof(Unit));
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		i32 wall, gold;
+		read_bytes(&in, &wall, sizeof(i32));
+		read_bytes(&in, &gold, sizeof(i32));
+		if (wall >= (i32)tiles || gold >= (i32)map->goldpiles.size())
+			in.failed = true;
+		map->units[i].wtarget = wall >= 0 && !in.failed ? &map->walls[wall] : NULL;
+		map->units[i].gtarget = gold >= 0 && !in.failed ? &map->goldpiles[gold] : NULL;
+	}
+	map->squads.resize(read_count(&in, sizeof(Squad)));
+	read_bytes(&in, map->squads.data(), map->squads.size() * sizeof(Squad));
+	for (u32 i = 0; i < map->units.size(); ++i) {
+		if (map->units[i].squad > map->squads.size())
+			in.failed = true;
+	}
+	for (u32 i = 0; i < map->squads.size(); ++i) {
+		if (map->squads[i].wall >= (i32)tiles || map->squads[i].goldpile >= (i32)map->goldpiles.size())
+			in.failed = true;
+	}
+
+	u32 count = read_count(&in, 1);
+	for (u32 i = 0; i < count && !in.failed; ++i) {
+		Projectile proj;
+		read_bytes(&in, &proj.x, sizeof(proj.x));
+		read_bytes(&in, &proj.y, sizeof(proj.y));
+		read_bytes(&in, &proj.rotation, sizeof(proj.rotation));
+		proj.type = (ProjectileType)read_u32(&in);
+		proj.owner = (Owner)read_u32(&in);
+		proj.animation = read_animation(&in, scene);
+		map->projectiles.push_back(proj);
+	}
+
+	count = read_count(&in, 1);
+	for (u32 i = 0; i < count && !in.failed; ++i) {
+		Explosion explosion;
+		read_bytes(&in, &explosion.x, sizeof(explosion.x));
+		read_bytes(&in, &explosion.y, sizeof(explosion.y));
+		explosion.animation = read_animation(&in, scene);
+		map->explosions.push_back(explosion);
+	}
+
+	loaded.waves.resize(read_count(&in, sizeof(u32)));
+	for (u32 i = 0; i < loaded.waves.size() && !in.failed; ++i) {
+		loaded.waves[i].resize(read_count(&in, sizeof(Group)));
+		read_bytes(&in, loaded.waves[i].data(), loaded.waves[i].size() * sizeof(Group));
+	}
+
+	count = read_count(&in, 1);
+	for (u32 i = 0; i < count && !in.failed; ++i) {
+		Notification note;
+		read_bytes(&in, &note.alpha, sizeof(f32));
+		note.text = read_string(&in);
+		loaded.notifications.push_back(note);
+	}
+	count = read_count(&in, 1);
+	for (u32 i = 0; i < count && !in.failed; ++i) {
+		StatusText note;
+		read_bytes(&in, &note.alpha, sizeof(f32));
+		read_bytes(&in, &note.pos, sizeof(vec2));
+		note.text = read_string(&in);
+		loaded.statusTexts.push_back(note);
+	}
+
+	if (in.failed) {
+		BMT_LOG(WARNING, "Snapshot is corrupt");
+		dispose_map(map);
+		return false;
+	}
+
+	//moved rather than copied, so the gold pile targets still point into the same buffer
+	dispose_map(&game->map);
+	*game = std::move(loaded);
+	randomEngine = engine;
+	return true;
+}
+
+static inline
+bool save_snapshot(Game* game, const char* filename) {
+	std::vector<u8> data;
+	write_snapshot(game, &data);
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Error opening file", filename);
+		return false;
+	}
+	bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return written;
+}
+
+static inline
+bool load_snapshot(Game* game, MapScene* scene, const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Error opening file", filename);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	std::vector<u8> data(size > 0 ? size : 0);
+	bool read = fread(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	if (!read) {
+		BMT_LOG(WARNING, "[%s] Error reading file", filename);
+		return false;
+	}
+	return read_snapshot(game, scene, data.data(), data.size());
+}
+
+//The ring keeps a snapshot every SNAPSHOT_RING_INTERVAL ticks for rewinding, plus one taken
+//when the current wave began for retrying it. Only the newest snapshot in the ring is kept
+//whole; each older one is stored as a delta against the one after it, so most of the map
+//costs a few bytes per snapshot and the ring stays around the size of one snapshot.
+
+#define SNAPSHOT_RING_SIZE		30
+#define SNAPSHOT_RING_INTERVAL	120		//two seconds at 60 ticks a second
+
+struct SnapshotEntry {
+	u32 tick;
+	std::vector<u8> data;
+};
+
+struct SnapshotRing {
+	SnapshotEntry entries[SNAPSHOT_RING_SIZE];
+	u32 first;
+	u32 count;
+	std::vector<u8> scratch;
+	std::vector<u8> delta;
+	std::vector<u8> waveStart;
+	u32 wave;
+};
+
+//XORs data against base and run-length encodes the zero runs, so a stretch that did not
+//change costs 8 bytes however long it is
+static inline
+void encode_delta(const std::vector<u8>& base, const std::vector<u8>& data, std::vector<u8>* out) {
+	const u8* b = base.data();
+	const u8* d = data.data();
+	u64 size = data.size();
+	u64 common = std::min(base.size(), data.size());
+	out->clear();
+	write_bytes(out, &size, sizeof(u64));
+
+	u64 i = 0;
+	while (i < size) {
+		u64 start = i;
+		while (i + 8 <= common && memcmp(d + i, b + i, 8) == 0)
+			i += 8;
+		while (i < size && d[i] == (i < common ? b[i] : 0))
+			++i;
+		u32 zeros = i - start;
+
+		//a literal run ends at the next run of 8 or more unchanged bytes
+		start = i;
+		u32 unchanged = 0;
+		while (i < size) {
+			if (d[i] == (i < common ? b[i] : 0)) {
+				if (++unchanged == 8) {
+					i -= 7;
+					break;
+				}
+			}
+			else {
+				unchanged = 0;
+			}
+			++i;
+		}
+		u32 literals = i - start;
+
+		write_u32(out, zeros);
+		write_u32(out, literals);
+		u64 at = out->size();
+		out->resize(at + literals);
+		for (u32 j = 0; j < literals; ++j)
+			(*out)[at + j] = d[start + j] ^ (start + j < common ? b[start + j] : 0);
+	}
+}
+
+static inline
+void decode_delta(const std::vector<u8>& base, const std::vector<u8>& delta, std::vector<u8>* out) {
+	SnapshotReader in = { delta.data(), delta.size(), 0, false };
+	u64 size = 0;
+	read_bytes(&in, &size, sizeof(u64));
+	u64 common = std::min((u64)base.size(), size);
+	out->resize(size);
+
+	u64 i = 0;
+	while (i < size && !in.failed) {
+		u32 zeros = read_u32(&in);
+		u32 literals = read_u32(&in);
+		if (zeros + (u64)literals > size - i || literals > in.size - in.at) {
+			in.failed = true;
+			break;
+		}
+		for (u64 end = i + zeros; i < end; ++i)
+			(*out)[i] = i < common ? base[i] : 0;
+		for (u64 end = i + literals; i < end; ++i)
+			(*out)[i] = in.data[in.at++] ^ (i < common ? base[i] : 0);
+	}
+	if (in.failed)
+		BMT_LOG(FATAL_ERROR, "Snapshot ring delta is corrupt");
+}
+
+static inline
+SnapshotEntry* ring_entry(SnapshotRing* ring, u32 index) {
+	return &ring->entries[(ring->first + index) % SNAPSHOT_RING_SIZE];
+}
+
+//the caller clears the ring whenever a new game starts, or rewinding could bring back the old one
+static inline
+void clear_snapshot_ring(SnapshotRing* ring) {
+	ring->first = 0;
+	ring->count = 0;
+	ring->waveStart.clear();
+}
+
+//takes a snapshot when one is due, the caller does not need to keep track of the interval
+static inline
+void update_snapshot_ring(SnapshotRing* ring, Game* game) {
+	TRACE_SCOPE("update_snapshot_ring");
+	if (ring->waveStart.empty() || game->currentWave != ring->wave) {
+		write_snapshot(game, &ring->waveStart);
+		ring->wave = game->currentWave;
+	}
+
+	if (ring->count > 0 && game->tick < ring_entry(ring, ring->count - 1)->tick + SNAPSHOT_RING_INTERVAL)
+		return;
+
+	write_snapshot(game, &ring->scratch);
+	if (ring->count > 0) {
+		SnapshotEntry* newest = ring_entry(ring, ring->count - 1);
+		encode_delta(ring->scratch, newest->data, &ring->delta);
+		newest->data.swap(ring->delta);
+	}
+	if (ring->count == SNAPSHOT_RING_SIZE) {
+		ring->first = (ring->first + 1) % SNAPSHOT_RING_SIZE;
+		ring->count--;
+	}
+
+	SnapshotEntry* entry = ring_entry(ring, ring->count++);
+	entry->tick = game->tick;
+	entry->data.swap(ring->scratch);
+}
+
+//forgets the newest snapshot, turning the one before it back into a whole snapshot
+static inline
+void drop_newest_snapshot(SnapshotRing* ring) {
+	SnapshotEntry* newest = ring_entry(ring, ring->count - 1);
+	if (ring->count > 1) {
+		SnapshotEntry* previous = ring_entry(ring, ring->count - 2);
+		decode_delta(newest->data, previous->data, &ring->scratch);
+		previous->data.swap(ring->scratch);
+	}
+	ring->count--;
+}
+
+//goes back to the newest snapshot that is at least half an interval old, so pressing it
+//again keeps stepping further back
+static inline
+bool rewind_snapshot(SnapshotRing* ring, Game* game, MapScene* scene) {
+	TRACE_SCOPE("rewind_snapshot");
+	while (ring->count > 1 && ring_entry(ring, ring->count - 1)->tick + SNAPSHOT_RING_INTERVAL / 2 > game->tick)
+		drop_newest_snapshot(ring);
+	if (ring->count == 0)
+		return false;
+
+	SnapshotEntry* newest = ring_entry(ring, ring->count - 1);
+	return read_snapshot(game, scene, newest->data.data(), newest->data.size());
+}
+
+//puts the game back to when the current wave began
+static inline
+bool retry_wave(SnapshotRing* ring, Game* game, MapScene* scene) {
+	TRACE_SCOPE("retry_wave");
+	if (ring->waveStart.empty() || !read_snapshot(game, scene, ring->waveStart.data(), ring->waveStart.size()))
+		return false;
+	while (ring->count > 0 && ring_entry(ring, ring->count - 1)->tick > game->tick)
+		drop_newest_snapshot(ring);
+	return true;
+}
+
+#endif
@@ -18,13 +18,18 @@ enum MainState {
 	MAIN_EXIT
 };
 
+//every random choice the game makes goes through this, so a seed reproduces a whole run
+GLOBAL std::mt19937 randomEngine(std::random_device{}());
+
 static inline
-i32 random_int(i32 min, i32 max) {
-	static std::random_device rd;
-	static std::mt19937 mt(rd());
+void seed_random(u32 seed) {
+	randomEngine.seed(seed);
+}
 
+static inline
+i32 random_int(i32 min, i32 max) {
 	std::uniform_int_distribution<> dist(0, max - min);
-	return dist(mt) + min;
+	return dist(randomEngine) + min;
 }
 
 struct Animation {
@@ -252,8 +257,113 @@ BitmapFont load_neighbors_font(u8 scale = 1) {
 	return font;
 }
 
+#define TEXT_MESH_MAX_GLYPHS	256
+#define TEXT_CACHE_SIZE			128
+
+//==========================================================================================
+//Description: The laid out glyphs of a string, so drawing it again is just a walk over the
+//			   glyph list instead of re-measuring every character.
+//
+//Comments: A newline starts a new line, but empty lines are skipped, the same way the
+//			tooltips have always split their text.
+//==========================================================================================
+struct TextMesh {
+	BitmapFont* font;
+	u32 hash;
+	u16 count;
+	u8 lines;
+	i32 width; //width of the widest line
+	char text[TEXT_MESH_MAX_GLYPHS];
+	char glyphs[TEXT_MESH_MAX_GLYPHS];
+	i16 xOffsets[TEXT_MESH_MAX_GLYPHS];
+	u8 lineOf[TEXT_MESH_MAX_GLYPHS];
+};
+
+//direct mapped by the hash of the string, so a mesh is only rebuilt when the text in its slot changes
+static TextMesh textCache[TEXT_CACHE_SIZE];
+
+static inline
+u32 hash_string(const char* str) {
+	u32 hash = 2166136261u;
+	for (const char* c = str; *c != '\0'; ++c)
+		hash = (hash ^ (u8)*c) * 16777619u;
+	return hash;
+}
+
+static inline
+void build_text_mesh(TextMesh* mesh, BitmapFont* font, const char* str, u32 hash) {
+	mesh->font = font;
+	mesh->hash = hash;
+	mesh->count = 0;
+	mesh->lines = 0;
+	mesh->width = 0;
+	strcpy(mesh->text, str);
+
+	i32 x = 0;
+	bool lineStarted = false;
+	for (const char* c = str; *c != '\0'; ++c) {
+		if (*c == '\n') {
+			if (lineStarted) {
+				mesh->lines++;
+				x = 0;
+				lineStarted = false;
+			}
+			continue;
+		}
+
+		//the font only has the ASCII range, anything past it has no glyph to draw
+		u8 glyph = (u8)*c;
+		if (glyph >= SCHAR_MAX)
+			continue;
+
+		mesh->glyphs[mesh->count] = glyph;
+		mesh->xOffsets[mesh->count] = x;
+		mesh->lineOf[mesh->count] = mesh->lines;
+		mesh->count++;
+		lineStarted = true;
+
+		x += font->chars[glyph].width - font->chars[1].width;
+		if (x > mesh->width)
+			mesh->width = x;
+	}
+	if (lineStarted)
+		mesh->lines++;
+}
+
+//==========================================================================================
+//Description: Returns the cached mesh for a string, building it if the text has changed.
+//
+//Comments: Returns NULL for strings too long to cache, which are drawn the slow way.
+//==========================================================================================
+static inline
+TextMesh* get_text_mesh(BitmapFont* font, const char* str) {
+	if (strlen(str) >= TEXT_MESH_MAX_GLYPHS)
+		return NULL;
+
+	u32 hash = hash_string(str);
+	TextMesh* mesh = &textCache[hash % TEXT_CACHE_SIZE];
+	if (mesh->font != font || mesh->hash != hash || strcmp(mesh->text, str) != 0)
+		build_text_mesh(mesh, font, str, hash);
+	return mesh;
+}
+
+static inline
+void draw_text_mesh(RenderBatch* batch, TextMesh* mesh, f32 x, f32 y, f32 r=255, f32 g=255, f32 b=255, f32 a=255) {
+	BitmapFont* font = mesh->font;
+	f32 lineHeight = font->chars['a'].height;
+	vec4 color = { r/255,g/255,b/255,a/255 };
+	for (u16 i = 0; i < mesh->count; ++i)
+		draw_texture(batch, font->chars[(u8)mesh->glyphs[i]], x + mesh->xOffsets[i], y + (lineHeight * mesh->lineOf[i]), color);
+}
+
 static inline
 void draw_text(RenderBatch* batch, BitmapFont* font, const char* str, f32 x, f32 y, f32 r=255, f32 g=255, f32 b=255, f32 a=255) {
+	TextMesh* mesh = get_text_mesh(font, str);
+	if (mesh != NULL) {
+		draw_text_mesh(batch, mesh, x, y, r, g, b, a);
+		return;
+	}
+
 	i32 len = strlen(str);
 	for (u16 i = 0; i < len; ++i) {
 		draw_texture(batch, font->chars[str[i]], x, y, { r/255,g/255,b/255,a/255 });
@@ -263,6 +373,10 @@ void draw_text(RenderBatch* batch, BitmapFont* font, const char* str, f32 x, f32
 
 static inline
 i32 get_string_width(BitmapFont* font, const char* str) {
+	TextMesh* mesh = get_text_mesh(font, str);
+	if (mesh != NULL)
+		return mesh->width;
+
 	i32 width = 0;
 	i32 len = strlen(str);
 	for (u16 i = 0; i < len; ++i) {
@@ -312,21 +426,25 @@ void draw_panel(RenderBatch* batch, Texture ninepatch[9], i32 x, i32 y, u16 widt
 }
 
 static inline
-bool text_button(RenderBatch* batch, BitmapFont* font, std::string str, i32* yInitial, vec2 mouse) {
+bool text_button(RenderBatch* batch, BitmapFont* font, const char* text, i32* yInitial, vec2 mouse) {
+	char str[TEXT_MESH_MAX_GLYPHS];
+	strncpy(str, text, TEXT_MESH_MAX_GLYPHS - 1);
+	str[TEXT_MESH_MAX_GLYPHS - 1] = '\0';
+
 	f32 height = 16 * 3;
-	f32 width = get_string_width(font, str.c_str());
+	f32 width = get_string_width(font, str);
 	f32 xPos = (get_window_width() / 2) - (width / 2);
 	f32 yPos = *yInitial += (16 * 3) + 15;
 	bool collided = colliding({ xPos, yPos, width, height }, { mouse.x, mouse.y });
 	if (collided) {
 		str[0] = '>';
 		str[1] = ' ';
-		draw_text(batch, font, str.c_str(), xPos, yPos);
+		draw_text(batch, font, str, xPos, yPos);
 	}
 	else {
 		str[0] = ' ';
 		str[1] = ' ';
-		draw_text(batch, font, str.c_str(), xPos, yPos);
+		draw_text(batch, font, str, xPos, yPos);
 	}
 
 	return collided & is_button_released(MOUSE_BUTTON_LEFT);
@@ -334,22 +452,75 @@ bool text_button(RenderBatch* batch, BitmapFont* font, std::string str, i32* yIn
 
 static inline
 void tooltip(RenderBatch* batch, BitmapFont* font, Texture ninepatch[9], const char* text, u8 width, u8 height, Rect rect, vec2 mouse) {
+	if (!colliding(rect, mouse.x, mouse.y))
+		return;
+
+	draw_panel(batch, ninepatch, rect.x + 60, rect.y, width, height);
+	TextMesh* mesh = get_text_mesh(font, text);
+	if (mesh != NULL) {
+		draw_text_mesh(batch, mesh, rect.x + 70, rect.y + 10);
+		return;
+	}
+
+	//too long to cache, so split it into lines and draw them one at a time
 	u32 numTokens = 0;
 	char** tokens = split_string(text, "\n", &numTokens);
+	for (u32 i = 0; i < numTokens; ++i)
+		draw_text(batch, font, tokens[i], rect.x + 70, rect.y + 10 + (font->chars['a'].height * i));
 
-	if (colliding(rect, mouse.x, mouse.y)) {
-		draw_panel(batch, ninepatch, rect.x + 60, rect.y, width, height);
-		for (u32 i = 0; i < numTokens; ++i)
-			draw_text(batch, font, tokens[i], rect.x + 70, rect.y + 10 + (font->chars['a'].height * i));
-	}
-
-	for (u8 i = 0; i < numTokens; ++i)
+	for (u32 i = 0; i < numTokens; ++i)
 		if (tokens[i] != NULL)
 			free(tokens[i]);
 	if (tokens != NULL)
 		free(tokens);
 }
 
+//==========================================================================================
+//Description: Draws the profiler's frame tree with the last, average, min and p99 times
+//			   of each scope over the rolling history, in milliseconds.
+//==========================================================================================
+static inline
+void draw_profiler_overlay(RenderBatch* batch, BitmapFont* font, f32 x, f32 y) {
+	u32 order[PROFILE_MAX_NODES];
+	u32 count = get_profile_tree_order(order);
+	f32 lineHeight = font->chars['a'].height;
+
+	draw_rectangle(batch, x, y, 560, (count + 1) * lineHeight + 10, 0, 0, 0, 180);
+	draw_text(batch, font, "scope", x + 5, y + 5, 255, 220, 120);
+	draw_text(batch, font, "last   avg   min   p99", x + 300, y + 5, 255, 220, 120);
+
+	for (u32 i = 0; i < count; ++i) {
+		ProfileNode* node = get_profile_node(order[i]);
+		ProfileStats stats = get_profile_stats(order[i]);
+		f32 lineY = y + 5 + (lineHeight * (i + 1));
+
+		draw_text(batch, font, node->name, x + 5 + (node->depth * 16), lineY);
+		draw_text(batch, font, format_text("%5.2f %5.2f %5.2f %5.2f", stats.last, stats.avg, stats.min, stats.p99), x + 300, lineY);
+	}
+
+	//last frame's batch counters, underneath the scope timings
+	RenderStats render = get_render_stats(batch);
+	f32 statsY = y + (count + 1) * lineHeight + 15;
+	draw_rectangle(batch, x, statsY, 560, (lineHeight * 5) + 10, 0, 0, 0, 180);
+	draw_text(batch, font, format_text("sprites %d  culled %d  textures %d", render.sprites, render.culled, render.uniqueTextures), x + 5, statsY + 5);
+	draw_text(batch, font, format_text("draw calls %d  flushes %d tex / %d buffer", render.drawCalls, render.textureFlushes, render.bufferFlushes), x + 5, statsY + 5 + lineHeight);
+	draw_text(batch, font, format_text("uploaded %.1f KB", render.bytesUploaded / 1024.0), x + 5, statsY + 5 + (lineHeight * 2));
+
+	//gpu times lag a few frames behind, since the queries are read back without waiting
+	GpuTimings gpu = get_gpu_timings(batch);
+	if (!batch->gpu.supported) {
+		draw_text(batch, font, "gpu timer queries not supported", x + 5, statsY + 5 + (lineHeight * 3));
+		return;
+	}
+	f32 slowest = 0;
+	for (u32 i = 0; i < gpu.flushCount; ++i) {
+		if (gpu.flushMs[i] > slowest)
+			slowest = gpu.flushMs[i];
+	}
+	draw_text(batch, font, format_text("gpu %5.2f ms  %d flushes  slowest %5.2f", gpu.frameMs, gpu.flushCount, slowest), x + 5, statsY + 5 + (lineHeight * 3));
+	draw_text(batch, font, format_text("gpu frames dropped %d", gpu.dropped), x + 5, statsY + 5 + (lineHeight * 4));
+}
+
 static inline
 bool button(RenderBatch* batch, Texture btn, Texture btnDown, i32 x, i32 y, vec2 mouse) {
 	Rect button = { x, y, btn.width, btn.height };